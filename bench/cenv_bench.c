@@ -0,0 +1,335 @@
+/**
+ * @file cenv_bench.c
+ * @brief Micro-benchmarks for loading, looking up and interpolating variables.
+ *
+ * Generates synthetic `.env` files with 10 up to `max_keys` keys, varying the
+ * value length and the share of values holding `${VAR}` placeholders, then
+ * reports load throughput, `dotenv_get` latency percentiles at 1 up to
+ * `max_threads` threads, before and after `dotenv_freeze`, and the peak
+ * resident set size. Each scenario runs in its own process, so the peak is
+ * that of the scenario rather than of every scenario before it.
+ *
+ * Usage: cenv_bench [max_keys] [max_threads] [directory]
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <cenv.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/// Number of timed `dotenv_get` calls made by each thread.
+#define BENCH_LOOKUPS_PER_THREAD 200000
+
+/**
+ * @struct bench_scenario
+ * @brief Shape of the values in a generated `.env` file.
+ */
+typedef struct {
+  const char *name;   ///< Short label printed in the report.
+  size_t value_len;   ///< Length of each literal value in bytes.
+  int ref_percent;    ///< Percentage of values holding a `${VAR}` reference.
+  unsigned flags;     ///< `DOTENV_LOAD_*` options used to load the file.
+} bench_scenario;
+
+/// Scenarios run for every key count.
+static const bench_scenario scenarios[] = {
+    {"short", 16, 0, 0},
+    {"long", 128, 0, 0},
+    {"interp", 16, 50, 0},
+    {"lazy", 16, 50, DOTENV_LOAD_LAZY},
+};
+
+/**
+ * @struct bench_worker
+ * @brief Arguments and results of a lookup thread.
+ */
+typedef struct {
+  int key_count;       ///< Number of keys loaded.
+  unsigned seed;       ///< Seed for picking keys.
+  uint64_t *latencies; ///< Receives one latency in nanoseconds per lookup.
+} bench_worker;
+
+/**
+ * @brief Reads a monotonic clock.
+ *
+ * @return The current time in nanoseconds.
+ */
+static uint64_t bench_now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Returns the peak resident set size of the process.
+ *
+ * @return The peak RSS in megabytes.
+ */
+static double bench_peak_rss_mb(void) {
+  struct rusage usage;
+
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+  return usage.ru_maxrss / 1024.0;
+#endif
+}
+
+/**
+ * @brief Advances a xorshift pseudo-random generator.
+ *
+ * @param state The generator state.
+ * @return The next pseudo-random number.
+ */
+static unsigned bench_rand(unsigned *state) {
+  unsigned x = *state;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+
+  return *state = x;
+}
+
+/**
+ * @brief Writes a synthetic `.env` file.
+ *
+ * Keys are named `KEY_<n>`. A value holding a reference points at a random
+ * earlier key, so every reference resolves.
+ *
+ * @param path Where to write the file.
+ * @param key_count Number of keys to generate.
+ * @param scenario Shape of the values.
+ * @return The size of the file in bytes, or 0 on error.
+ */
+static size_t bench_generate(const char *path, int key_count,
+                             const bench_scenario *scenario) {
+  FILE *file = fopen(path, "w");
+
+  if (!file) {
+    perror("Failed to create benchmark file.");
+    return 0;
+  }
+
+  char *value = malloc(scenario->value_len + 1);
+  unsigned seed = 2463534242u;
+
+  for (size_t i = 0; i < scenario->value_len; i++) {
+    value[i] = 'a' + (char)(i % 26);
+  }
+
+  value[scenario->value_len] = '\0';
+
+  for (int i = 0; i < key_count; i++) {
+    if (i > 0 && (int)(bench_rand(&seed) % 100) < scenario->ref_percent) {
+      fprintf(file, "KEY_%d=%s_${KEY_%d}\n", i, value,
+              (int)(bench_rand(&seed) % i));
+    } else {
+      fprintf(file, "KEY_%d=%s\n", i, value);
+    }
+  }
+
+  free(value);
+
+  long size = ftell(file);
+
+  fclose(file);
+  return size > 0 ? (size_t)size : 0;
+}
+
+/**
+ * @brief Performs timed lookups of random keys.
+ *
+ * @param arg The `bench_worker` of this thread.
+ * @return NULL.
+ */
+static void *bench_lookup_worker(void *arg) {
+  bench_worker *worker = arg;
+  char key[32];
+
+  for (int i = 0; i < BENCH_LOOKUPS_PER_THREAD; i++) {
+    snprintf(key, sizeof(key), "KEY_%d",
+             (int)(bench_rand(&worker->seed) % worker->key_count));
+
+    uint64_t start = bench_now_ns();
+    const char *value = dotenv_get(key);
+    uint64_t end = bench_now_ns();
+
+    if (!value) {
+      fprintf(stderr, "Missing key %s\n", key);
+    }
+
+    worker->latencies[i] = end - start;
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Orders latencies for `qsort`.
+ */
+static int bench_compare(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief Measures `dotenv_get` latency with a number of concurrent threads.
+ *
+ * @param label Short label printed in the report.
+ * @param key_count Number of keys loaded.
+ * @param threads Number of lookup threads.
+ */
+static void bench_lookups(const char *label, int key_count, int threads) {
+  size_t total = (size_t)threads * BENCH_LOOKUPS_PER_THREAD;
+  uint64_t *latencies = malloc(sizeof(uint64_t) * total);
+  bench_worker *workers = malloc(sizeof(bench_worker) * threads);
+  pthread_t *ids = malloc(sizeof(pthread_t) * threads);
+
+  uint64_t start = bench_now_ns();
+
+  for (int t = 0; t < threads; t++) {
+    workers[t].key_count = key_count;
+    workers[t].seed = 88172645u + (unsigned)t * 7919u;
+    workers[t].latencies = latencies + (size_t)t * BENCH_LOOKUPS_PER_THREAD;
+    pthread_create(&ids[t], NULL, bench_lookup_worker, &workers[t]);
+  }
+
+  for (int t = 0; t < threads; t++) {
+    pthread_join(ids[t], NULL);
+  }
+
+  double seconds = (bench_now_ns() - start) / 1e9;
+
+  qsort(latencies, total, sizeof(uint64_t), bench_compare);
+
+  printf("  %-6s threads=%-3d p50=%-6llu p90=%-6llu p99=%-6llu p99.9=%-7llu "
+         "max=%-8llu Mops/s=%.2f\n",
+         label, threads, (unsigned long long)latencies[total / 2],
+         (unsigned long long)latencies[total * 9 / 10],
+         (unsigned long long)latencies[total * 99 / 100],
+         (unsigned long long)latencies[total * 999 / 1000],
+         (unsigned long long)latencies[total - 1], total / seconds / 1e6);
+
+  free(ids);
+  free(workers);
+  free(latencies);
+}
+
+/**
+ * @brief Measures loading a generated file, then lookups in its first
+ * scenario.
+ *
+ * @param path The generated file.
+ * @param keys The number of keys in the file.
+ * @param s The index of the scenario in `scenarios`.
+ * @param size The size of the file in bytes.
+ * @param max_threads The largest number of lookup threads.
+ * @return 0 on success, -1 if the file cannot be loaded.
+ */
+static int bench_scenario_run(const char *path, int keys, size_t s,
+                              size_t size, int max_threads) {
+  // Small files are loaded repeatedly so the timer has something to see
+  int repeats = keys < 100000 ? 1000000 / keys : 1;
+  uint64_t elapsed = 0;
+
+  for (int r = 0; r < repeats; r++) {
+    dotenv_free();
+
+    uint64_t start = bench_now_ns();
+
+    if (dotenv_load_ex(path, scenarios[s].flags) == -1)
+      return -1;
+
+    elapsed += bench_now_ns() - start;
+  }
+
+  double seconds = elapsed / 1e9 / repeats;
+
+  printf("load keys=%-8d values=%-6s file=%8.2fMB time=%9.3fms "
+         "MB/s=%8.1f peak_rss=%.1fMB\n",
+         keys, scenarios[s].name, size / 1e6, seconds * 1e3,
+         size / 1e6 / seconds, bench_peak_rss_mb());
+
+  if (s == 0) {
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+      bench_lookups("get", keys, threads);
+    }
+
+    if (dotenv_freeze() == 0) {
+      for (int threads = 1; threads <= max_threads; threads *= 2) {
+        bench_lookups("frozen", keys, threads);
+      }
+
+      dotenv_thaw();
+    }
+  }
+
+  dotenv_free();
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int max_keys = argc > 1 ? atoi(argv[1]) : 1000000;
+  int max_threads = argc > 2 ? atoi(argv[2]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  const char *directory = argc > 3 ? argv[3] : "/tmp";
+  char path[4096];
+
+  if (max_keys < 10 || max_threads < 1) {
+    fprintf(stderr, "Usage: %s [max_keys>=10] [max_threads>=1] [directory]\n",
+            argv[0]);
+    return 1;
+  }
+
+  snprintf(path, sizeof(path), "%s/cenv_bench_%ld.env", directory,
+           (long)getpid());
+
+  printf("latencies in ns, including clock overhead\n");
+
+  for (int keys = 10; keys <= max_keys; keys *= 10) {
+    for (size_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++) {
+      size_t size = bench_generate(path, keys, &scenarios[s]);
+      int status;
+
+      if (size == 0)
+        return 1;
+
+      fflush(stdout);
+
+      pid_t pid = fork();
+
+      if (pid == -1) {
+        perror("Failed to start the benchmark process");
+        remove(path);
+        return 1;
+      }
+
+      if (pid == 0) {
+        int result = bench_scenario_run(path, keys, s, size, max_threads);
+
+        fflush(stdout);
+        _exit(result == 0 ? 0 : 1);
+      }
+
+      if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) ||
+          WEXITSTATUS(status) != 0) {
+        remove(path);
+        return 1;
+      }
+    }
+  }
+
+  remove(path);
+  return 0;
+}
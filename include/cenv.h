@@ -1,370 +1,6003 @@
 #ifndef CENV_H
 #define CENV_H
 
+/**
+ * @file cenv.h
+ * @brief Loads environment variables from `.env` files.
+ *
+ * Link against `libcenv` (see `make lib`), or define `CENV_IMPLEMENTATION` in
+ * exactly one source file before including this header to compile the
+ * implementation into that file. Either way, a single set of loaded variables
+ * is shared by the whole process.
+ *
+ * Binaries whose configuration is fixed at build time can instead include a
+ * header generated by `cenv_embed` (see `make embed`), which defines
+ * `CENV_EMBEDDED` and compiles the variables in.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#define ENV_NEWLINE "\r\n" ///< Windows newline
+#else
+#define ENV_NEWLINE "\n" ///< Linux/macOS newline
+#endif
+
+/**
+ * @brief Computes the 64-bit FNV-1a hash of a key.
+ *
+ * @param key The key to hash (need not be NUL-terminated).
+ * @param len The length of the key in bytes.
+ * @return The hash of the key.
+ */
+static inline uint64_t dotenv_hash(const char *key, size_t len) {
+  uint64_t hash = 14695981039346656037ULL;
+
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (unsigned char)key[i];
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
+
+/**
+ * @brief Scrambles the bits of a hash.
+ *
+ * FNV-1a leaves the high bits of short keys poorly mixed, so the perfect hash
+ * functions go through this SplitMix64 finalizer first.
+ *
+ * @param x The value to scramble.
+ * @return The scrambled value.
+ */
+static inline uint64_t dotenv_phash_mix(uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+/**
+ * @brief Picks the perfect hash bucket of a key.
+ *
+ * @param hash The hash of the key, as returned by `dotenv_hash`.
+ * @param bucket_count The number of buckets.
+ * @return The bucket of the key, below `bucket_count`.
+ */
+static inline uint32_t dotenv_phash_bucket(uint64_t hash,
+                                           uint32_t bucket_count) {
+  return (uint32_t)((dotenv_phash_mix(hash) >> 32) * bucket_count >> 32);
+}
+
+/**
+ * @brief Maps a key to a perfect hash slot.
+ *
+ * Scrambles the hash with the seed chosen for its bucket and scales the result
+ * to the number of slots.
+ *
+ * @param hash The hash of the key, as returned by `dotenv_hash`.
+ * @param seed The seed of the key's bucket.
+ * @param slot_count The number of slots.
+ * @return The slot of the key, below `slot_count`.
+ */
+static inline uint32_t dotenv_phash_slot(uint64_t hash, uint32_t seed,
+                                         uint32_t slot_count) {
+  uint64_t x = dotenv_phash_mix(hash + (seed + 1) * 0x9E3779B97F4A7C15ULL);
+
+  return (uint32_t)((x & 0xFFFFFFFFu) * slot_count >> 32);
+}
+
+/**
+ * @brief Finds the slot of a key in a minimal perfect hash.
+ *
+ * @param hash The hash of the key, as returned by `dotenv_hash`.
+ * @param count The number of keys.
+ * @param slot_count The number of slots the seeds spread keys over.
+ * @param bucket_count The number of buckets.
+ * @param seeds The seed of each bucket.
+ * @param remap The final slot of each slot from `count` up.
+ * @return The slot of the key if it is in the set, below `count`.
+ */
+static inline uint32_t dotenv_phash_find(uint64_t hash, uint32_t count,
+                                         uint32_t slot_count,
+                                         uint32_t bucket_count,
+                                         const uint32_t *seeds,
+                                         const uint32_t *remap) {
+  uint32_t seed = seeds[dotenv_phash_bucket(hash, bucket_count)];
+  uint32_t slot = dotenv_phash_slot(hash, seed, slot_count);
+
+  return slot < count ? slot : remap[slot - count];
+}
+
+#ifdef CENV_EMBEDDED
+#include <string.h>
+
+/**
+ * @brief Retrieves the value associated with a specific key.
+ *
+ * In embedded mode the variables are the ones compiled into the header
+ * generated by `cenv_embed`, which must be included instead of this one. The
+ * lookup hashes the key and checks the single slot the perfect hash maps it
+ * to, with no allocation and nothing to load at startup.
+ *
+ * @param key The key of the variable to search for.
+ * @return The value associated with the key, or `NULL` if the key is not found.
+ */
+static inline const char *dotenv_get(const char *key) {
+  if (DOTENV_EMBEDDED_COUNT == 0)
+    return NULL;
+
+  uint64_t hash = dotenv_hash(key, strlen(key));
+  uint32_t slot = dotenv_phash_find(
+      hash, DOTENV_EMBEDDED_COUNT, DOTENV_EMBEDDED_SLOTS,
+      DOTENV_EMBEDDED_BUCKETS, dotenv_embedded_seeds, dotenv_embedded_remap);
+
+  if (dotenv_embedded_hashes[slot] != hash ||
+      strcmp(dotenv_embedded_keys[slot], key) != 0)
+    return NULL;
+
+  return dotenv_embedded_values[slot];
+}
+#else
+
+/**
+ * @brief Loads environment variables from a `.env` file, with variable
+ * interpolation.
+ *
+ * Maps the whole file into memory and parses it in place in a single pass,
+ * so lines of any length are supported and no line is copied before its key
+ * and value are stored. Parsing happens without holding any lock, into a
+ * private table sized once from a line count of the file and a private arena;
+ * the entries are then committed in one batch, so readers never observe a
+ * partially loaded file and are never blocked while it is parsed.
+ *
+ * A `${VAR}` placeholder may refer to a key defined anywhere in the file or
+ * loaded earlier. Values are resolved in dependency order; a reference cycle
+ * is reported with the keys involved and fails the load.
+ *
+ * @param filename Path to the `.env` file.
+ * @return 0 if the file is successfully loaded, -1 if the file cannot be
+ * opened or holds a reference cycle.
+ */
+int dotenv_load(const char *filename);
+
+/// Parse large files on several threads, see `dotenv_load_ex`.
+#define DOTENV_LOAD_PARALLEL 0x1u
+
+/// Expand `${VAR}` placeholders on first read, see `dotenv_load_ex`.
+#define DOTENV_LOAD_LAZY 0x2u
+
+/// Also index the process environment, see `dotenv_load_ex`.
+#define DOTENV_LOAD_ENVIRON 0x4u
+
+/// Like `DOTENV_LOAD_ENVIRON`, letting the environment win over the file.
+#define DOTENV_LOAD_ENVIRON_WINS 0x8u
+
+/**
+ * @brief Loads environment variables from a `.env` file with load options.
+ *
+ * Behaves like `dotenv_load`, adjusted by `flags`:
+ * - `DOTENV_LOAD_PARALLEL` splits a large file on line boundaries into one
+ *   chunk per thread. Each thread tokenizes its chunk into its own table and
+ *   arena, and the chunks are merged in file order, so the result is
+ *   identical to a serial load.
+ * - `DOTENV_LOAD_LAZY` stores values as written and expands their
+ *   placeholders on the first read of each key, so loading costs nothing for
+ *   keys that are never read. Expansions see the same definitions as an eager
+ *   load and are computed once. References are still followed at load time
+ *   to find cycles, which fail the load as they do without this flag.
+ * - `DOTENV_LOAD_ENVIRON` copies the process environment into the same index
+ *   as the file, so `dotenv_get` answers from either source with one lookup
+ *   and `${VAR}` placeholders see both. The file wins over the environment,
+ *   and a value referring to its own key, such as `PATH=${PATH}:/opt/bin`,
+ *   extends the environment's value. `DOTENV_LOAD_ENVIRON_WINS` does the same
+ *   but lets the environment win over the file. The environment is copied
+ *   once, at load time.
+ *
+ * @param filename Path to the `.env` file.
+ * @param flags Bitwise OR of `DOTENV_LOAD_*` options, or 0.
+ * @return 0 if the file is successfully loaded, -1 otherwise.
+ */
+int dotenv_load_ex(const char *filename, unsigned flags);
+
+/**
+ * @brief Loads several layered `.env` files as one configuration.
+ *
+ * The files are parsed concurrently on a small pool of threads and merged in
+ * order, so a key defined in a later file overrides the same key in earlier
+ * files and in previously loaded ones. Within a file the first definition of
+ * a key wins, as with `dotenv_load`. Interpolation then runs once over the
+ * merged result, so `${VAR}` sees the winning definition, except that a value
+ * referring to its own key, such as `PATH=${PATH}:/opt/bin`, extends the
+ * definition from the earlier files. Nothing is published unless every file
+ * loads.
+ *
+ * @param files Paths of the files, from lowest to highest precedence.
+ * @param count Number of files.
+ * @return 0 if every file is successfully loaded, -1 otherwise.
+ */
+int dotenv_load_layers(const char **files, size_t count);
+
+/**
+ * @brief Compiles a `.env` file into a binary image.
+ *
+ * The file is parsed and fully resolved on its own, then written to `dst` as
+ * a versioned image holding a header, one entry per key with its hash and
+ * lengths, the hash index of the keys, and the keys and values, checksummed
+ * so a damaged image is rejected. Images are only portable between machines
+ * with the same byte order. The image is written to a
+ * temporary file renamed over `dst`, so processes that loaded the previous
+ * image keep reading it safely.
+ *
+ * @param src Path to the `.env` file.
+ * @param dst Path of the image to write.
+ * @return 0 if the image is written, -1 if the file cannot be loaded or the
+ * image cannot be written.
+ */
+int dotenv_compile(const char *src, const char *dst);
+
+/**
+ * @brief Loads an image written by `dotenv_compile`.
+ *
+ * The image is mapped read-only and its checksum validated. Nothing is parsed
+ * or copied: keys, values and hashes are used in place. When nothing else is
+ * loaded yet, the image becomes the published table as is: its hash index is
+ * adopted, and conversion caches are zeroed pages that are only touched when
+ * a value is first converted, so startup costs one pass over the image.
+ * Otherwise the variables are merged like a file loaded with `dotenv_load`.
+ * The image stays mapped until `dotenv_free`.
+ *
+ * @param filename Path to the image.
+ * @return 0 if the image is loaded, -1 if it cannot be read or is invalid.
+ */
+int dotenv_load_compiled(const char *filename);
+
+/**
+ * @brief Generates a C header embedding a `.env` file.
+ *
+ * The file is parsed and fully resolved on its own, then written to `dst` as
+ * `static const` tables of keys and values, with a minimal perfect hash over
+ * the keys. Including that header instead of `cenv.h` defines `CENV_EMBEDDED`,
+ * and `dotenv_get` then answers from the tables with a single probe, without
+ * any file or runtime state. Used by the `cenv_embed` tool (see `make embed`).
+ *
+ * @param src Path to the `.env` file.
+ * @param dst Path of the header to write.
+ * @return 0 if the header is written, -1 if the file cannot be loaded or the
+ * header cannot be written.
+ */
+int dotenv_embed(const char *src, const char *dst);
+
+/**
+ * @brief Loads a `.env` file and reloads it whenever it changes.
+ *
+ * The file is loaded like with `dotenv_load_ex`, except that its keys override
+ * previously loaded ones. A background thread then watches its directory with
+ * inotify, so both writes and atomic renames over the file are seen. On each
+ * change the file is parsed again into a fresh table off the read path, and
+ * its previous entries are replaced in one atomic publication: readers see
+ * either the old or the new configuration, never a mix of both. A key
+ * removed from the file reverts to the definition the file was first loaded
+ * over, or disappears if there was none. If a reload fails, the previous
+ * configuration stays in place.
+ *
+ * Reloads are incremental: only lines that changed are tokenized again, and
+ * only values depending on changed keys are interpolated again. Unchanged
+ * entries keep their storage, so their values are the same pointers as
+ * before. `DOTENV_LOAD_PARALLEL` and `DOTENV_LOAD_ENVIRON` have no effect on
+ * watched files.
+ *
+ * Only one file can be watched at a time. Supported on Linux only.
+ *
+ * @param filename Path to the `.env` file.
+ * @param flags Bitwise OR of `DOTENV_LOAD_*` options used on every load, or 0.
+ * @return 0 if the file is loaded and watched, -1 otherwise.
+ */
+int dotenv_watch(const char *filename, unsigned flags);
+
+/**
+ * @brief Stops watching the file passed to `dotenv_watch`.
+ *
+ * Waits for a reload in progress to finish. The loaded variables are kept.
+ * Does nothing if no file is watched.
+ */
+void dotenv_unwatch(void);
+
+/**
+ * @brief Retrieves the value associated with a specific key.
+ *
+ * Searches for the value of a key previously loaded from the `.env` file. The
+ * lookup reads the currently published table and never takes a lock.
+ *
+ * @param key The key of the variable to search for.
+ * @return The value associated with the key, or `NULL` if the key is not found.
+ */
+const char *dotenv_get(const char *key);
+
+/**
+ * @brief Retrieves the value of a key along with its length.
+ *
+ * Behaves like `dotenv_get`, but also returns the length of the value, which
+ * is stored with it at load time, so callers never need `strlen`. The value
+ * is not copied and stays valid until `dotenv_free`.
+ *
+ * @param key The key of the variable to search for.
+ * @param value Receives the value (NUL-terminated), or NULL if not found.
+ * @param len Receives the length of the value in bytes, or 0 if not found.
+ * @return 0 if the key is found, -1 otherwise.
+ */
+int dotenv_get_view(const char *key, const char **value, size_t *len);
+
+/**
+ * @brief Callback of `dotenv_foreach_prefix`.
+ *
+ * @param key The key of a variable.
+ * @param value Its value.
+ * @param user The pointer passed to `dotenv_foreach_prefix`.
+ * @return 0 to continue, any other value to stop.
+ */
+typedef int (*dotenv_visitor)(const char *key, const char *value, void *user);
+
+/**
+ * @struct dotenv_cursor
+ * @brief Position of an iteration over the keys starting with a prefix.
+ *
+ * Filled by `dotenv_cursor_open`; its fields are private.
+ */
+typedef struct {
+  const void *table; ///< Snapshot being iterated.
+  int next;          ///< Next position in key order.
+  int end;           ///< One past the last position with the prefix.
+  void *pin;         ///< Keeps the snapshot alive, or NULL once released.
+} dotenv_cursor;
+
+/**
+ * @brief Starts iterating over the variables whose key starts with a prefix.
+ *
+ * Variables are visited in bytewise key order. The first prefix query on a
+ * set of loaded variables sorts their keys once; every query then finds its
+ * range with a binary search, so visiting `k` of `n` keys costs
+ * O(log n + k). The iteration sees the variables loaded when it started,
+ * even if more are loaded meanwhile; superseded variables are kept for it
+ * until it reaches its end or `dotenv_cursor_close` is called.
+ *
+ * @param cursor The cursor to fill.
+ * @param prefix The prefix, such as `"DB_"`, or `""` for every variable.
+ * @return 0 on success, -1 if memory allocation fails.
+ */
+int dotenv_cursor_open(dotenv_cursor *cursor, const char *prefix);
+
+/**
+ * @brief Moves a cursor to its next variable.
+ *
+ * @param cursor A cursor filled by `dotenv_cursor_open`.
+ * @param key Receives the key of the variable.
+ * @param value Receives its value.
+ * @return 0 if a variable was found, -1 once the iteration is over.
+ */
+int dotenv_cursor_next(dotenv_cursor *cursor, const char **key,
+                       const char **value);
+
+/**
+ * @brief Stops an iteration before its end.
+ *
+ * Releases the variables the cursor kept alive. Values it returned stay
+ * valid. Closing a cursor that reached its end, or closing it twice, does
+ * nothing.
+ *
+ * @param cursor A cursor filled by `dotenv_cursor_open`.
+ */
+void dotenv_cursor_close(dotenv_cursor *cursor);
+
+/**
+ * @brief Calls a function for each variable whose key starts with a prefix.
+ *
+ * Visits the variables in the same order as a `dotenv_cursor`, at the same
+ * cost.
+ *
+ * @param prefix The prefix, such as `"DB_"`, or `""` for every variable.
+ * @param visit The function to call; a nonzero return stops the iteration.
+ * @param user Pointer passed to `visit`.
+ * @return 0 on success, -1 if memory allocation fails.
+ */
+int dotenv_foreach_prefix(const char *prefix, dotenv_visitor visit,
+                          void *user);
+
+/// Handle to an interned key, see `dotenv_intern`.
+typedef int dotenv_handle;
+
+/// Handle returned when a key cannot be interned.
+#define DOTENV_INVALID_HANDLE (-1)
+
+/**
+ * @brief Interns a key for repeated lookups.
+ *
+ * Resolves the key to a stable slot once. The slot is redirected whenever a
+ * load publishes new variables, so a handle never goes stale and may be
+ * obtained before the key is loaded. Interning the same key again returns the
+ * same handle. Handles stay valid until `dotenv_free`.
+ *
+ * @param key The key to intern.
+ * @return A handle for `dotenv_get_h`, or `DOTENV_INVALID_HANDLE` on error.
+ */
+dotenv_handle dotenv_intern(const char *key);
+
+/**
+ * @brief Retrieves the value of an interned key.
+ *
+ * A single indexed load, without hashing or comparing the key.
+ *
+ * @param handle A handle returned by `dotenv_intern`.
+ * @return The value associated with the key, or `NULL` if the key is not
+ * loaded or the handle is invalid.
+ */
+const char *dotenv_get_h(dotenv_handle handle);
+
+/**
+ * @brief Retrieves a value as a signed decimal integer.
+ *
+ * The value is parsed on the first read and the result is cached beside the
+ * variable, so later reads of the same value skip the conversion.
+ *
+ * @param key The key of the variable.
+ * @param out Receives the integer.
+ * @return 0 on success, -1 if the key is not found or is not an integer.
+ */
+int dotenv_get_int64(const char *key, int64_t *out);
+
+/**
+ * @brief Retrieves a value as a boolean.
+ *
+ * Accepts `true`/`false`, `yes`/`no`, `on`/`off` and `1`/`0`, ignoring case.
+ * The result is cached like `dotenv_get_int64`.
+ *
+ * @param key The key of the variable.
+ * @param out Receives 1 for true and 0 for false.
+ * @return 0 on success, -1 if the key is not found or is not a boolean.
+ */
+int dotenv_get_bool(const char *key, int *out);
+
+/**
+ * @brief Retrieves a value as a floating-point number.
+ *
+ * The result is cached like `dotenv_get_int64`.
+ *
+ * @param key The key of the variable.
+ * @param out Receives the number.
+ * @return 0 on success, -1 if the key is not found or is not a number.
+ */
+int dotenv_get_double(const char *key, double *out);
+
+/**
+ * @brief Retrieves a value as a duration in nanoseconds.
+ *
+ * Accepts a sequence of numbers with units `ns`, `us`, `ms`, `s`, `m` or `h`,
+ * such as `1h30m` or `1.5s`, optionally preceded by `-`. A bare `0` is also
+ * accepted. The result is cached like `dotenv_get_int64`.
+ *
+ * @param key The key of the variable.
+ * @param out Receives the duration in nanoseconds.
+ * @return 0 on success, -1 if the key is not found or is not a duration.
+ */
+int dotenv_get_duration_ns(const char *key, int64_t *out);
+
+/**
+ * @brief Retrieves a value as a size in bytes.
+ *
+ * Accepts a number with an optional suffix, ignoring case: `B`, `K`/`KiB`,
+ * `M`/`MiB`, `G`/`GiB` and `T`/`TiB` are powers of 1024, while `KB`, `MB`,
+ * `GB` and `TB` are powers of 1000. The result is cached like
+ * `dotenv_get_int64`.
+ *
+ * @param key The key of the variable.
+ * @param out Receives the size in bytes.
+ * @return 0 on success, -1 if the key is not found or is not a size.
+ */
+int dotenv_get_bytes(const char *key, uint64_t *out);
+
+/// Let loaded values replace existing environment variables, see
+/// `dotenv_export`.
+#define DOTENV_EXPORT_OVERWRITE 0x1u
+
+/**
+ * @brief Exports the loaded variables into the process environment.
+ *
+ * Builds a new `environ` array in one pass: the current environment, with
+ * loaded values substituted or added, followed by the loaded keys it did not
+ * have. The `KEY=VALUE` strings are stored in an arena, and the array is
+ * installed with a single pointer swap, so exporting `n` keys costs O(n)
+ * instead of one `setenv` scan of the environment per key. Child processes
+ * and `getenv` then see the loaded values.
+ *
+ * Like `setenv`, this is not safe while other threads read the environment.
+ * Not supported on Windows.
+ *
+ * @param flags `DOTENV_EXPORT_OVERWRITE` to let loaded values replace existing
+ * variables with the same name, or 0 to keep the existing ones.
+ * @return 0 on success, -1 otherwise.
+ */
+int dotenv_export(unsigned flags);
+
+/**
+ * @brief Freezes the loaded variables into a read-only perfect hash.
+ *
+ * Builds a minimal perfect hash over the keys of the published table, with
+ * every value expanded up front, so `dotenv_get` then finds any key with one
+ * probe into a compact array and never takes a lock. Handles and the typed
+ * accessors keep working. Loading more variables fails until `dotenv_thaw`
+ * is called. Does nothing if the variables are already frozen.
+ *
+ * @return 0 on success, -1 if two keys have the same 64-bit hash or memory
+ * allocation fails.
+ */
+int dotenv_freeze(void);
+
+/**
+ * @brief Undoes `dotenv_freeze`, so variables can be loaded again.
+ *
+ * Lookups go back to the regular table. Does nothing if the variables are not
+ * frozen.
+ */
+void dotenv_thaw(void);
+
+/**
+ * @brief Frees the memory allocated for loaded environment variables.
+ *
+ * Releases the arena holding every key and value in one sweep over its blocks,
+ * along with every table published so far and every interned key, which
+ * invalidates all handles, and thaws frozen variables. Stops watching a file
+ * first. Exported variables are taken back out of the environment: each
+ * gets back the value it replaced, or is removed if it was added. Variables
+ * the program set or changed itself since the export are kept. Must not be
+ * called while other threads may still read variables.
+ */
+void dotenv_free(void);
+#endif // CENV_EMBEDDED
+
+#endif // CENV_H
+
+#if defined(CENV_IMPLEMENTATION) && defined(CENV_EMBEDDED)
+#error "CENV_IMPLEMENTATION cannot be combined with CENV_EMBEDDED"
+#endif
+
+#ifdef CENV_IMPLEMENTATION
+#ifndef CENV_IMPLEMENTATION_INCLUDED
+#define CENV_IMPLEMENTATION_INCLUDED
+
+#include <errno.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#ifdef _WIN32
-#define ENV_NEWLINE "\r\n" ///< Windows newline
-#else
-#define ENV_NEWLINE "\n" ///< Linux/macOS newline
-#endif
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+#ifdef _WIN32
+#define dotenv_environ _environ ///< The process environment
+#else
+extern char **environ;
+#define dotenv_environ environ ///< The process environment
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define DOTENV_SIMD_X86 1 ///< SSE2/AVX2 scanners are available
+#endif
+
+/**
+ * @struct dotenv_scope
+ * @brief Tables the placeholders of a lazily loaded file are resolved against.
+ *
+ * Filled in when the file's entries are published, so a lazy value expands to
+ * what an eager load would have produced.
+ */
+typedef struct {
+  const struct dotenv_table *table;       ///< Table the entries went into.
+  const struct dotenv_table *base;        ///< Previous definitions.
+  const struct dotenv_table *environment; ///< Environment snapshot, or NULL.
+} dotenv_scope;
+
+/**
+ * @struct dotenv_cache
+ * @brief Conversion of a value cached by the typed accessors.
+ *
+ * Holds the result of the first conversion of a value. Conversions of the
+ * same value to other types are computed on each read instead. The cache is
+ * created with its value, so a value that changes gets a fresh cache.
+ *
+ * A value loaded with `DOTENV_LOAD_LAZY` also keeps its expansion here, since
+ * its entry is copied into every later snapshot. The two 32-bit fields share
+ * a word, so the cache takes 40 bytes on 64-bit targets.
+ */
+typedef struct {
+  _Atomic uint32_t state; ///< Cached type, `DOTENV_CACHE_*` while not cached.
+  int visiting; ///< Set while being expanded (guarded by `ctx.mutex`).
+  _Atomic uint64_t bits;          ///< The converted result.
+  _Atomic(const char *) expanded; ///< Expansion of a lazy value, or NULL.
+  size_t expanded_len;            ///< Length of `expanded`, stored before it.
+  const dotenv_scope *scope;      ///< Where a lazy value is resolved, or NULL.
+} dotenv_cache;
+
+/// Nothing is cached yet.
+#define DOTENV_CACHE_EMPTY 0
+
+/// A conversion is being stored.
+#define DOTENV_CACHE_BUSY 1
+
+/// Flag marking a cached conversion that failed.
+#define DOTENV_CACHE_FAILED 0x80u
+
+/**
+ * @struct env_var
+ * @brief Structure representing an environment variable.
+ *
+ * Contains a key-value pair for an environment variable.
+ */
+typedef struct {
+  char *key;           ///< The key of the environment variable.
+  char *value;         ///< The value associated with the key (NULL if lazy).
+  char *raw;           ///< The value as written, before interpolation.
+  size_t key_len;      ///< Length of `key`.
+  size_t value_len;    ///< Length of `value`, once set.
+  size_t raw_len;      ///< Length of `raw`.
+  uint64_t hash;       ///< Hash of the key, computed once at load time.
+  dotenv_cache *cache; ///< Typed conversion of the value.
+} env_var;
+
+/**
+ * @struct dotenv_order
+ * @brief Entries of a table sorted by key, for prefix queries.
+ */
+typedef struct {
+  int count;       ///< Number of visible entries.
+  int positions[]; ///< Their positions in `vars`, in key order.
+} dotenv_order;
+
+/**
+ * @struct dotenv_table
+ * @brief Immutable snapshot of the loaded environment variables.
+ *
+ * Holds the loaded variables in insertion order, their count, the allocated
+ * capacity, and an open-addressing hash index used for lookups. Once a table
+ * has been published it is never modified, so readers can use it without
+ * taking a lock; only its key order is added on the first prefix query.
+ */
+typedef struct dotenv_table {
+  env_var *vars;      ///< Dynamic array of environment variables.
+  int var_count;      ///< Number of currently loaded variables.
+  int capacity;       ///< Capacity of the dynamic array.
+  int *index;         ///< Hash index into `vars` (-1 marks an empty slot).
+  int index_capacity; ///< Number of index slots (always a power of two).
+  _Atomic(dotenv_order *) order;     ///< Key order, built on first use.
+  struct dotenv_table *next_retired; ///< Next superseded table, if retired.
+  unsigned long retired_epoch;       ///< Reader epoch when it was retired.
+  int mark; ///< `DOTENV_MARK_*` state (guarded by `ctx.mutex`).
+} dotenv_table;
+
+/// The table is published, private to a load, or never retired.
+#define DOTENV_MARK_LIVE 0
+
+/// The table is retired and not known to be reachable.
+#define DOTENV_MARK_RETIRED 1
+
+/// The table is retired but may still be read.
+#define DOTENV_MARK_REACHED 2
+
+/// The table is reachable and its lazy values have been followed.
+#define DOTENV_MARK_SCANNED 3
+
+/**
+ * @struct dotenv_reader
+ * @brief Read counters of one thread, alone on their cache line.
+ *
+ * A thread gets its slot on its first read and gives it back when it exits,
+ * for the next new thread to take; slots are never freed.
+ */
+typedef struct dotenv_reader {
+  _Alignas(64) _Atomic long count[2]; ///< Reads in progress, per epoch parity.
+  _Atomic int owned;                  ///< Whether a thread holds the slot.
+  struct dotenv_reader *next;         ///< Next registered slot.
+} dotenv_reader;
+
+/**
+ * @struct dotenv_arena_block
+ * @brief Block of contiguous storage handed out by a `dotenv_arena`.
+ */
+typedef struct dotenv_arena_block {
+  struct dotenv_arena_block *next; ///< Previously filled block.
+  size_t used;                     ///< Number of bytes handed out.
+  size_t size;                     ///< Number of bytes available in `data`.
+  char data[];                     ///< Storage for keys and values.
+} dotenv_arena_block;
+
+/**
+ * @struct dotenv_arena
+ * @brief Bump allocator storing the bytes of keys and values contiguously.
+ *
+ * Allocations are never freed individually; the whole arena is released at
+ * once.
+ */
+typedef struct {
+  dotenv_arena_block *head; ///< Block currently being filled.
+  dotenv_arena_block *tail; ///< Oldest block, used to splice arenas.
+} dotenv_arena;
+
+/**
+ * @struct dotenv_slot
+ * @brief Slot of an interned key, addressed by a `dotenv_handle`.
+ */
+typedef struct {
+  const char *key;              ///< The interned key.
+  uint64_t hash;                ///< Hash of the key.
+  _Atomic(const char *) value;  ///< Value in the published table, or NULL.
+} dotenv_slot;
+
+/// Number of slots allocated at once for interned keys.
+#define DOTENV_SLOT_CHUNK_SIZE 256
+
+/// Maximum number of slot chunks, bounding the number of interned keys.
+#define DOTENV_SLOT_CHUNKS 1024
+
+/**
+ * @struct dotenv_phash
+ * @brief Minimal perfect hash over a set of keys.
+ *
+ * See `dotenv_phash_find` for the lookup.
+ */
+typedef struct {
+  uint32_t count;        ///< Number of keys, and of final slots.
+  uint32_t slot_count;   ///< Number of slots the seeds spread keys over.
+  uint32_t bucket_count; ///< Number of buckets.
+  uint32_t *seeds;       ///< Seed of each bucket.
+  uint32_t *remap;       ///< Final slot of each slot from `count` up.
+} dotenv_phash;
+
+/**
+ * @struct dotenv_frozen_entry
+ * @brief Variable of a frozen table, stored in its perfect hash slot.
+ */
+typedef struct {
+  uint64_t hash;     ///< Hash of the key.
+  const char *key;   ///< The key.
+  const char *value; ///< The fully expanded value, or NULL.
+  size_t key_len;    ///< Length of `key`.
+  size_t value_len;  ///< Length of `value`.
+} dotenv_frozen_entry;
+
+/**
+ * @struct dotenv_frozen
+ * @brief Read-only index built by `dotenv_freeze`.
+ */
+typedef struct dotenv_frozen {
+  dotenv_phash phash;                 ///< Perfect hash over the keys.
+  dotenv_frozen_entry *entries;       ///< One entry per slot.
+  struct dotenv_frozen *next_retired; ///< Next thawed index, if retired.
+} dotenv_frozen;
+
+/**
+ * @struct dotenv_context
+ * @brief Internal structure to manage environment variables.
+ *
+ * Publishes the current table through an atomic pointer. Writers serialize on
+ * the mutex, build a new table and swap it in; readers only load the pointer,
+ * after announcing themselves in a reader counter. Superseded tables are kept
+ * on a retired list until no reader can still be using them, see
+ * `dotenv_reclaim`. The bytes of every key and value live in the arena and
+ * stay until `dotenv_free`, so values returned by `dotenv_get` outlive the
+ * table they were found in.
+ *
+ * Interned keys live in fixed-size chunks of slots that never move, so a
+ * handle can be read without a lock while new keys are interned. A small hash
+ * index maps keys to their handles for `dotenv_intern`.
+ */
+typedef struct {
+  _Atomic(dotenv_table *) table; ///< Currently published snapshot.
+  dotenv_table *retired;         ///< Superseded snapshots awaiting release.
+  const dotenv_table *pinned;    ///< Snapshot kept by the watcher, or NULL.
+  _Atomic unsigned long epoch;   ///< Reader epoch, see `dotenv_reclaim`.
+  _Atomic(dotenv_reader *) readers; ///< Slots of the threads that read.
+  dotenv_reader shared_reader;   ///< Used if a slot cannot be allocated.
+  dotenv_arena arena;            ///< Storage for keys and values.
+  _Atomic(dotenv_slot *) slot_chunks[DOTENV_SLOT_CHUNKS]; ///< Interned keys.
+  int slot_count;                ///< Number of interned keys.
+  int *slot_index;               ///< Hash index into the slots (-1 if empty).
+  int slot_index_capacity;       ///< Number of slot index entries.
+  char **exported;               ///< Array installed by `dotenv_export`.
+  char **original_environ;       ///< Environment it last replaced.
+  dotenv_arena export_arena;     ///< Storage for exported strings.
+  struct dotenv_image *images;   ///< Images mapped by `dotenv_load_compiled`.
+  _Atomic(dotenv_frozen *) frozen; ///< Index built by `dotenv_freeze`.
+  dotenv_frozen *thawed;         ///< Indexes thawed since, awaiting release.
+  pthread_mutex_t mutex;         ///< Mutex serializing writers.
+} dotenv_context;
+
+/// Internal context to manage the loaded variables (hidden from the user).
+static dotenv_context ctx = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+/// Default size of an arena block in bytes.
+#define DOTENV_ARENA_BLOCK_SIZE (64 * 1024)
+
+/**
+ * @brief Allocates bytes from an arena.
+ *
+ * Starts a new block when the current one is full. Requests larger than a
+ * block get a block of their own.
+ *
+ * @param arena The arena to allocate from.
+ * @param size The number of bytes to allocate.
+ * @param align The required alignment (a power of two, at most that of
+ * `max_align_t`; 1 for strings).
+ * @return The allocated bytes, or NULL if memory allocation fails.
+ */
+static char *dotenv_arena_alloc(dotenv_arena *arena, size_t size,
+                                size_t align) {
+  dotenv_arena_block *block = arena->head;
+  size_t padding =
+      block ? (0 - (uintptr_t)(block->data + block->used)) & (align - 1) : 0;
+
+  if (!block || block->size - block->used < size + padding) {
+    size_t block_size =
+        size > DOTENV_ARENA_BLOCK_SIZE ? size : DOTENV_ARENA_BLOCK_SIZE;
+
+    block = malloc(sizeof(dotenv_arena_block) + block_size);
+
+    if (!block)
+      return NULL;
+
+    block->next = arena->head;
+    block->used = 0;
+    block->size = block_size;
+
+    arena->head = block;
+    padding = (0 - (uintptr_t)block->data) & (align - 1);
+
+    if (!arena->tail) {
+      arena->tail = block;
+    }
+  }
+
+  char *ptr = block->data + block->used + padding;
+  block->used += size + padding;
+
+  return ptr;
+}
+
+/**
+ * @brief Moves every block of one arena into another.
+ *
+ * @param dst The arena receiving the blocks.
+ * @param src The arena giving up its blocks (left empty).
+ */
+static void dotenv_arena_splice(dotenv_arena *dst, dotenv_arena *src) {
+  if (!src->head)
+    return;
+
+  src->tail->next = dst->head;
+  dst->head = src->head;
+
+  if (!dst->tail) {
+    dst->tail = src->tail;
+  }
+
+  src->head = NULL;
+  src->tail = NULL;
+}
+
+/**
+ * @brief Releases every block of an arena.
+ *
+ * @param arena The arena to release.
+ */
+static void dotenv_arena_release(dotenv_arena *arena) {
+  while (arena->head) {
+    dotenv_arena_block *next = arena->head->next;
+    free(arena->head);
+    arena->head = next;
+  }
+
+  arena->tail = NULL;
+}
+
+/// Initial number of slots in the hash index.
+#define DOTENV_INDEX_INITIAL_CAPACITY 16
+
+/**
+ * @brief Looks up a key in the hash index of a table.
+ *
+ * @param table The table to search (may be NULL).
+ * @param key The key to search for (need not be NUL-terminated).
+ * @param len The length of the key in bytes.
+ * @param hash The hash of `key`, as returned by `dotenv_hash`.
+ * @return The position of the variable in `table->vars`, or -1 if not found.
+ */
+static int dotenv_index_find(const dotenv_table *table, const char *key,
+                             size_t len, uint64_t hash) {
+  if (!table || !table->index)
+    return -1;
+
+  size_t mask = (size_t)table->index_capacity - 1;
+
+  for (size_t slot = (size_t)hash & mask;; slot = (slot + 1) & mask) {
+    int pos = table->index[slot];
+
+    if (pos == -1)
+      return -1;
+
+    const env_var *candidate = &table->vars[pos];
+
+    // Bytes are only compared once the hash and the length match
+    if (candidate->hash == hash && candidate->key_len == len &&
+        memcmp(candidate->key, key, len) == 0)
+      return pos;
+  }
+}
+
+/**
+ * @brief Places a variable into the first free slot of its probe sequence.
+ *
+ * The caller must guarantee that a free slot exists.
+ *
+ * @param table The table being built.
+ * @param pos The position of the variable in `table->vars`.
+ */
+static void dotenv_index_place(dotenv_table *table, int pos) {
+  size_t mask = (size_t)table->index_capacity - 1;
+  size_t slot = (size_t)table->vars[pos].hash & mask;
+
+  while (table->index[slot] != -1) {
+    slot = (slot + 1) & mask;
+  }
+
+  table->index[slot] = pos;
+}
+
+/**
+ * @brief Rebuilds the hash index of a table with a new number of slots.
+ *
+ * @param table The table being built.
+ * @param new_capacity The new number of slots (must be a power of two).
+ * @return 0 on success, -1 if memory allocation fails.
+ */
+static int dotenv_index_rebuild(dotenv_table *table, int new_capacity) {
+  int *new_index = malloc(sizeof(int) * new_capacity);
+
+  if (!new_index) {
+    perror("Failed to allocate memory for the hash index.");
+    return -1;
+  }
+
+  memset(new_index, -1, sizeof(int) * new_capacity);
+  free(table->index);
+
+  table->index = new_index;
+  table->index_capacity = new_capacity;
+
+  for (int i = 0; i < table->var_count; i++) {
+    // Earlier entries win, matching the first-match semantics of lookups
+    const env_var *var = &table->vars[i];
+
+    if (dotenv_index_find(table, var->key, var->key_len, var->hash) == -1) {
+      dotenv_index_place(table, i);
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Adds a newly appended variable to the hash index of a table.
+ *
+ * Grows the index so that it stays at most half full. If the key is already
+ * indexed, the earlier entry is kept so lookups keep returning the first match.
+ *
+ * @param table The table being built.
+ * @param pos The position of the variable in `table->vars`.
+ * @return 0 on success, -1 if memory allocation fails.
+ */
+static int dotenv_index_insert(dotenv_table *table, int pos) {
+  if ((pos + 1) * 2 > table->index_capacity) {
+    int new_capacity = table->index_capacity ? table->index_capacity * 2
+                                             : DOTENV_INDEX_INITIAL_CAPACITY;
+
+    while ((pos + 1) * 2 > new_capacity) {
+      new_capacity *= 2;
+    }
+
+    // Rebuilding covers every entry up to var_count, including this one
+    return dotenv_index_rebuild(table, new_capacity);
+  }
+
+  const env_var *var = &table->vars[pos];
+
+  if (dotenv_index_find(table, var->key, var->key_len, var->hash) == -1) {
+    dotenv_index_place(table, pos);
+  }
+
+  return 0;
+}
+
+/**
+ * @struct dotenv_span
+ * @brief Read-only view of a byte range inside the loaded file.
+ */
+typedef struct {
+  const char *ptr; ///< First byte of the range.
+  size_t len;      ///< Number of bytes in the range.
+} dotenv_span;
+
+/**
+ * @brief Removes leading and trailing whitespace from a span,
+ *        and also removes leading and trailing double quotes if present.
+ *
+ * Narrows the span to drop any spaces, tabs, or newline characters from the
+ * beginning and the end. It also drops quotes at the start and end of the
+ * span, if they exist. The underlying bytes are not modified.
+ *
+ * @param str The span to trim.
+ * @return The trimmed span.
+ */
+static dotenv_span trim_whitespace(dotenv_span str) {
+  // Trim leading spaces
+  while (str.len > 0 && (*str.ptr == ' ' || *str.ptr == '\t' ||
+                         *str.ptr == '\n' || *str.ptr == '\r')) {
+    str.ptr++;
+    str.len--;
+  }
+
+  // Trim trailing spaces
+  while (str.len > 0) {
+    char last = str.ptr[str.len - 1];
+
+    if (last != ' ' && last != '\t' && last != '\n' && last != '\r')
+      break;
+
+    str.len--;
+  }
+
+  // Remove leading and trailing quotes if present
+  if (str.len > 0 && *str.ptr == '"') {
+    str.ptr++;
+    str.len--;
+  }
+
+  if (str.len > 0 && str.ptr[str.len - 1] == '"') {
+    str.len--;
+  }
+
+  return str;
+}
+
+/**
+ * @brief Finds the next structural byte (`\n`, `=`, `#` or `"`) one byte at a
+ * time.
+ *
+ * @param p Where to start scanning.
+ * @param end One past the last byte to scan.
+ * @return The position of the first structural byte, or `end` if none.
+ */
+static const char *dotenv_scan_scalar(const char *p, const char *end) {
+  for (; p < end; p++) {
+    if (*p == '\n' || *p == '=' || *p == '#' || *p == '"')
+      return p;
+  }
+
+  return end;
+}
+
+#ifdef DOTENV_SIMD_X86
+/**
+ * @brief Finds the next structural byte, classifying 16 bytes at a time.
+ *
+ * @param p Where to start scanning.
+ * @param end One past the last byte to scan.
+ * @return The position of the first structural byte, or `end` if none.
+ */
+__attribute__((target("sse2"))) static const char *
+dotenv_scan_sse2(const char *p, const char *end) {
+  const __m128i newline = _mm_set1_epi8('\n');
+  const __m128i equals = _mm_set1_epi8('=');
+  const __m128i hash = _mm_set1_epi8('#');
+  const __m128i quote = _mm_set1_epi8('"');
+
+  while (end - p >= 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+    __m128i hits = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, newline),
+                     _mm_cmpeq_epi8(chunk, equals)),
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, hash), _mm_cmpeq_epi8(chunk, quote)));
+    unsigned mask = (unsigned)_mm_movemask_epi8(hits);
+
+    if (mask)
+      return p + __builtin_ctz(mask);
+
+    p += 16;
+  }
+
+  return dotenv_scan_scalar(p, end);
+}
+
+/**
+ * @brief Finds the next structural byte, classifying 32 bytes at a time.
+ *
+ * @param p Where to start scanning.
+ * @param end One past the last byte to scan.
+ * @return The position of the first structural byte, or `end` if none.
+ */
+__attribute__((target("avx2"))) static const char *
+dotenv_scan_avx2(const char *p, const char *end) {
+  const __m256i newline = _mm256_set1_epi8('\n');
+  const __m256i equals = _mm256_set1_epi8('=');
+  const __m256i hash = _mm256_set1_epi8('#');
+  const __m256i quote = _mm256_set1_epi8('"');
+
+  while (end - p >= 32) {
+    __m256i chunk = _mm256_loadu_si256((const __m256i *)p);
+    __m256i hits = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, newline),
+                        _mm256_cmpeq_epi8(chunk, equals)),
+        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, hash),
+                        _mm256_cmpeq_epi8(chunk, quote)));
+    unsigned mask = (unsigned)_mm256_movemask_epi8(hits);
+
+    if (mask)
+      return p + __builtin_ctz(mask);
+
+    p += 32;
+  }
+
+  return dotenv_scan_sse2(p, end);
+}
+#endif
+
+/// Structural byte scanner chosen for the running CPU.
+static const char *(*dotenv_scan)(const char *, const char *) =
+    dotenv_scan_scalar;
+
+/// Guards the one-time selection of `dotenv_scan`.
+static pthread_once_t dotenv_scan_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Picks the widest structural byte scanner the CPU supports.
+ */
+static void dotenv_scan_select(void) {
+#ifdef DOTENV_SIMD_X86
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2")) {
+    dotenv_scan = dotenv_scan_avx2;
+  } else if (__builtin_cpu_supports("sse2")) {
+    dotenv_scan = dotenv_scan_sse2;
+  }
+#endif
+}
+
+/**
+ * @brief Splits the next line of a `.env` file into its key and value.
+ *
+ * Walks the line once, jumping between structural bytes: `"` toggles the
+ * quoted state, the first `=` is the delimiter, a `#` outside quotes starts a
+ * comment that runs to the end of the line, and `\n` ends the line. Blank
+ * lines, comment lines and lines without a delimiter hold no pair. Whitespace,
+ * quotes and trailing comments are trimmed from both halves.
+ *
+ * @param cursor Start of the line; advanced to the start of the next line.
+ * @param end One past the last byte of the file.
+ * @param key Receives the key.
+ * @param value Receives the raw (not yet interpolated) value.
+ * @return 1 if the line holds a key-value pair, 0 otherwise.
+ */
+static int dotenv_parse_line(const char **cursor, const char *end,
+                             dotenv_span *key, dotenv_span *value) {
+  const char *line = *cursor;
+  const char *delimiter = NULL;
+  const char *line_end = end;
+  int inside_quotes = 0;
+
+  *cursor = end;
+
+  for (const char *p = dotenv_scan(line, end); p < end;
+       p = dotenv_scan(p + 1, end)) {
+    if (*p == '\n') {
+      line_end = p;
+      *cursor = p + 1;
+      break;
+    }
+
+    if (*p == '"') {
+      inside_quotes = !inside_quotes; // Toggle inside_quotes state
+    } else if (*p == '=') {
+      if (!delimiter) {
+        delimiter = p;
+      }
+    } else if (!inside_quotes) {
+      // Cut the line before the #, the rest only matters for its newline
+      const char *newline = memchr(p, '\n', end - p);
+
+      line_end = p;
+      *cursor = newline ? newline + 1 : end;
+      break;
+    }
+  }
+
+  if (!delimiter)
+    return 0;
+
+  dotenv_span key_part = {line, (size_t)(delimiter - line)};
+  dotenv_span value_part = {delimiter + 1, (size_t)(line_end - delimiter - 1)};
+
+  *key = trim_whitespace(key_part);
+  *value = trim_whitespace(value_part);
+
+  return key->len > 0;
+}
+
+/**
+ * @struct dotenv_file
+ * @brief Whole contents of a `.env` file, mapped or read into memory.
+ */
+typedef struct {
+  const char *data; ///< File contents (not NUL-terminated, NULL if empty).
+  size_t size;      ///< Size of the contents in bytes.
+} dotenv_file;
+
+/**
+ * @brief Maps a whole file into memory for parsing.
+ *
+ * Uses a read-only `mmap` where available and falls back to a single `fread`
+ * into a heap buffer on Windows.
+ *
+ * @param filename Path to the file.
+ * @param file Receives the file contents.
+ * @return 0 on success, -1 if the file cannot be opened or read.
+ */
+static int dotenv_map_file(const char *filename, dotenv_file *file) {
+  file->data = NULL;
+  file->size = 0;
+
+#ifdef _WIN32
+  FILE *stream = fopen(filename, "rb");
+
+  if (!stream)
+    return -1;
+
+  if (fseek(stream, 0, SEEK_END) != 0) {
+    fclose(stream);
+    return -1;
+  }
+
+  long size = ftell(stream);
+
+  if (size < 0 || fseek(stream, 0, SEEK_SET) != 0) {
+    fclose(stream);
+    return -1;
+  }
+
+  if (size > 0) {
+    char *data = malloc((size_t)size);
+
+    if (!data || fread(data, 1, (size_t)size, stream) != (size_t)size) {
+      free(data);
+      fclose(stream);
+      return -1;
+    }
+
+    file->data = data;
+    file->size = (size_t)size;
+  }
+
+  fclose(stream);
+#else
+  int fd = open(filename, O_RDONLY);
+
+  if (fd == -1)
+    return -1;
+
+  struct stat st;
+
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return -1;
+  }
+
+  if (st.st_size > 0) {
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (data == MAP_FAILED) {
+      close(fd);
+      return -1;
+    }
+
+    file->data = data;
+    file->size = (size_t)st.st_size;
+  }
+
+  // The mapping stays valid after the descriptor is closed
+  close(fd);
+#endif
+
+  return 0;
+}
+
+/**
+ * @brief Releases the memory holding a file mapped by `dotenv_map_file`.
+ *
+ * @param file The file to release.
+ */
+static void dotenv_unmap_file(dotenv_file *file) {
+  if (file->data) {
+#ifdef _WIN32
+    free((void *)file->data);
+#else
+    munmap((void *)file->data, file->size);
+#endif
+  }
+
+  file->data = NULL;
+  file->size = 0;
+}
+
+/**
+ * @brief Copies a span into a NUL-terminated string stored in an arena.
+ *
+ * @param arena The arena to allocate from.
+ * @param str The span to copy.
+ * @return The new string, or NULL if memory allocation fails.
+ */
+static char *dotenv_arena_strndup(dotenv_arena *arena, dotenv_span str) {
+  char *copy = dotenv_arena_alloc(arena, str.len + 1, 1);
+
+  if (copy) {
+    memcpy(copy, str.ptr, str.len);
+    copy[str.len] = '\0';
+  }
+
+  return copy;
+}
+
+/**
+ * @brief Computes the number of index slots needed for a number of entries.
+ *
+ * @param count The number of entries the index must hold.
+ * @return A power of two keeping the index at most half full.
+ */
+static int dotenv_index_capacity_for(int count) {
+  int index_capacity = DOTENV_INDEX_INITIAL_CAPACITY;
+
+  while (count * 2 > index_capacity) {
+    index_capacity *= 2;
+  }
+
+  return index_capacity;
+}
+
+/**
+ * @brief Creates a new, empty table.
+ *
+ * Both the entry array and the index are sized up front, so adding up to
+ * `initial_capacity` entries never reallocates.
+ *
+ * @param initial_capacity Initial capacity for the environment variable array.
+ * @return The new table, or NULL if memory allocation fails.
+ */
+static dotenv_table *dotenv_table_create(int initial_capacity) {
+  dotenv_table *table = calloc(1, sizeof(dotenv_table));
+
+  if (!table) {
+    perror("Failed to allocate memory for environment variables.");
+    return NULL;
+  }
+
+  table->capacity = initial_capacity > 0 ? initial_capacity : 1;
+  table->vars = malloc(sizeof(env_var) * table->capacity);
+  table->index_capacity = dotenv_index_capacity_for(table->capacity);
+  table->index = malloc(sizeof(int) * table->index_capacity);
+
+  if (!table->vars || !table->index) {
+    perror("Failed to allocate memory for environment variables.");
+    free(table->vars);
+    free(table->index);
+    free(table);
+    return NULL;
+  }
+
+  memset(table->index, -1, sizeof(int) * table->index_capacity);
+
+  return table;
+}
+
+/**
+ * @brief Creates a table holding the entries of one table followed by those
+ * of another.
+ *
+ * The entry array and the index are allocated once at their final size. Keys
+ * and values are shared with the source tables. By default entries of `base`
+ * win over entries of `extra` with the same key; with `replace`, entries of
+ * `base` that `extra` redefines are dropped instead. Entries of `base` whose
+ * key is in `drop` are always left out.
+ *
+ * @param base The published table (may be NULL).
+ * @param extra The newly parsed entries.
+ * @param replace Whether `extra` overrides `base`.
+ * @param drop Keys to remove from `base` (may be NULL).
+ * @return The merged table, or NULL if memory allocation fails.
+ */
+static dotenv_table *dotenv_table_merge(const dotenv_table *base,
+                                        const dotenv_table *extra, int replace,
+                                        const dotenv_table *drop) {
+  int base_count = base ? base->var_count : 0;
+  dotenv_table *table = dotenv_table_create(base_count + extra->var_count);
+
+  if (!table)
+    return NULL;
+
+  for (int i = 0; i < base_count; i++) {
+    const env_var *var = &base->vars[i];
+    size_t len = var->key_len;
+
+    if (replace && dotenv_index_find(extra, var->key, len, var->hash) != -1)
+      continue;
+
+    if (dotenv_index_find(drop, var->key, len, var->hash) != -1)
+      continue;
+
+    table->vars[table->var_count] = *var;
+    table->var_count++;
+  }
+
+  memcpy(table->vars + table->var_count, extra->vars,
+         sizeof(env_var) * extra->var_count);
+
+  int count = table->var_count + extra->var_count;
+
+  // The index is already large enough, so inserting never rebuilds it
+  for (int i = 0; i < count; i++) {
+    table->var_count = i + 1;
+    dotenv_index_insert(table, i);
+  }
+
+  return table;
+}
+
+/**
+ * @brief Counts the lines of a mapped file.
+ *
+ * Every key-value pair sits on its own line, so this bounds the number of
+ * entries a file can produce and lets the staging table be sized once.
+ *
+ * @param data The file contents.
+ * @param size The size of the contents in bytes.
+ * @return The number of lines, counting a final line without a newline.
+ */
+static int dotenv_count_lines(const char *data, size_t size) {
+  const char *cursor = data;
+  const char *end = data + size;
+  int lines = 0;
+
+  while (cursor < end) {
+    const char *newline = memchr(cursor, '\n', end - cursor);
+
+    lines++;
+    cursor = newline ? newline + 1 : end;
+  }
+
+  return lines;
+}
+
+/**
+ * @brief Releases a table without touching the keys and values it references.
+ *
+ * @param table The table to release.
+ */
+static void dotenv_table_destroy(dotenv_table *table) {
+  free(table->vars);
+  free(table->index);
+  free(atomic_load_explicit(&table->order, memory_order_relaxed));
+  free(table);
+}
+
+/**
+ * @brief Resizes the array of environment variables of a table.
+ *
+ * Doubles the capacity to accommodate more variables when needed.
+ *
+ * @param table The table being built.
+ * @return 0 on success, -1 if memory allocation fails.
+ */
+static int dotenv_resize(dotenv_table *table) {
+  int new_capacity = table->capacity * 2;
+  env_var *new_vars = realloc(table->vars, sizeof(env_var) * new_capacity);
+
+  if (!new_vars) {
+    perror("Failed to resize environment variable array.");
+    return -1;
+  }
+
+  table->vars = new_vars;
+  table->capacity = new_capacity;
+
+  return 0;
+}
+
+/**
+ * @struct dotenv_buffer
+ * @brief Growable byte buffer used to build expanded values.
+ */
+typedef struct {
+  char *data;      ///< Buffer contents, always NUL-terminated when non-NULL.
+  size_t length;   ///< Number of bytes written, excluding the terminator.
+  size_t capacity; ///< Allocated size of `data`.
+} dotenv_buffer;
+
+/**
+ * @brief Appends bytes to a buffer, growing it geometrically when needed.
+ *
+ * @param buffer The buffer to append to.
+ * @param src The bytes to append.
+ * @param len The number of bytes to append.
+ * @return 0 on success, -1 if memory allocation fails.
+ */
+static int dotenv_buffer_append(dotenv_buffer *buffer, const char *src,
+                                size_t len) {
+  if (buffer->length + len + 1 > buffer->capacity) {
+    size_t new_capacity = buffer->capacity ? buffer->capacity : 64;
+
+    while (buffer->length + len + 1 > new_capacity) {
+      new_capacity *= 2;
+    }
+
+    char *new_data = realloc(buffer->data, new_capacity);
+
+    if (!new_data)
+      return -1;
+
+    buffer->data = new_data;
+    buffer->capacity = new_capacity;
+  }
+
+  memcpy(buffer->data + buffer->length, src, len);
+  buffer->length += len;
+  buffer->data[buffer->length] = '\0';
+
+  return 0;
+}
+
+/**
+ * @struct dotenv_resolver
+ * @brief State of the interpolation of a freshly parsed table.
+ */
+typedef struct {
+  const dotenv_table *base;        ///< The published table (may be NULL).
+  const dotenv_table *drop;        ///< Keys of `base` to ignore (may be NULL).
+  const dotenv_table *previous;    ///< Definitions seen by self references.
+  const dotenv_table *environment; ///< Environment snapshot, or NULL.
+  const dotenv_table *table;       ///< The table being resolved.
+  const int *below;                ///< Overridden definitions, or NULL.
+  int table_wins;                  ///< Whether `table` wins over `base`.
+  dotenv_buffer scratch;           ///< Reusable buffer used while expanding.
+  dotenv_arena *arena;             ///< Arena the resolved values are stored in.
+} dotenv_resolver;
+
+/**
+ * @brief Finds the next `${name}` placeholder in a raw value.
+ *
+ * A `$` that does not open a placeholder is part of the literal text. An
+ * unterminated `${` ends the search, as there is no closing brace left to
+ * find.
+ *
+ * @param cursor Where to start searching.
+ * @param end One past the last byte of the value.
+ * @param start Receives the end of the literal text before the placeholder
+ * (the `$` of the placeholder, an unterminated `${`, or `end`).
+ * @param name Receives the placeholder name.
+ * @return 1 if a placeholder was found, 0 otherwise.
+ */
+static int dotenv_next_placeholder(const char *cursor, const char *end,
+                                   const char **start, dotenv_span *name) {
+  for (const char *p = memchr(cursor, '$', end - cursor); p;
+       p = memchr(p + 1, '$', end - p - 1)) {
+    if (p + 1 < end && p[1] == '{') {
+      const char *close = memchr(p + 2, '}', end - p - 2);
+
+      *start = p;
+
+      if (!close)
+        return 0;
+
+      name->ptr = p + 2;
+      name->len = close - name->ptr;
+      return 1;
+    }
+  }
+
+  *start = end;
+  return 0;
+}
+
+/// Expansion of a lazy value that depends on a reference cycle.
+static const char dotenv_unresolved[] = "";
+
+/**
+ * @struct dotenv_lazy_frame
+ * @brief Entry on the depth-first stack of `dotenv_expand_locked`.
+ */
+typedef struct {
+  const env_var *var; ///< The value being expanded.
+  const char *cursor; ///< Where to look for its next placeholder.
+  const char *end;    ///< One past the last byte of its raw value.
+} dotenv_lazy_frame;
+
+/**
+ * @brief Returns the entry a placeholder of a lazy value refers to.
+ *
+ * Follows the same rules as `dotenv_resolver_target`: the table the value was
+ * published in holds the winning definitions, and a value referring to its own
+ * key reads the environment snapshot loaded with it, then the previous
+ * definition.
+ *
+ * @param var The lazy value.
+ * @param name The placeholder name.
+ * @return The referenced entry, or NULL if the key is not defined.
+ */
+static const env_var *dotenv_lazy_target(const env_var *var,
+                                         dotenv_span name) {
+  const dotenv_scope *scope = var->cache->scope;
+  uint64_t hash = dotenv_hash(name.ptr, name.len);
+  int pos = dotenv_index_find(scope->table, name.ptr, name.len, hash);
+
+  if (pos == -1 || scope->table->vars[pos].cache != var->cache)
+    return pos != -1 ? &scope->table->vars[pos] : NULL;
+
+  pos = dotenv_index_find(scope->environment, name.ptr, name.len, hash);
+
+  if (pos != -1)
+    return &scope->environment->vars[pos];
+
+  pos = dotenv_index_find(scope->base, name.ptr, name.len, hash);
+
+  return pos != -1 ? &scope->base->vars[pos] : NULL;
+}
+
+/**
+ * @brief Returns the value of an entry if it needs no further expansion.
+ *
+ * @param var The entry.
+ * @return The value, `dotenv_unresolved` if it depends on a cycle, or NULL if
+ * it is lazy and not expanded yet.
+ */
+static const char *dotenv_var_ready(const env_var *var) {
+  if (var->value)
+    return var->value;
+
+  return atomic_load_explicit(&var->cache->expanded, memory_order_acquire);
+}
+
+/**
+ * @brief Returns the length of a value returned by `dotenv_var_ready`.
+ *
+ * @param var The entry, whose value must be ready.
+ * @return The length of the value.
+ */
+static size_t dotenv_var_length(const env_var *var) {
+  return var->value ? var->value_len : var->cache->expanded_len;
+}
+
+/**
+ * @brief Pushes a lazy value on the expansion stack.
+ *
+ * @param frames The stack, grown geometrically when full.
+ * @param capacity The number of frames allocated.
+ * @param depth The number of frames in use, incremented on success.
+ * @param var The value to push.
+ * @return 0 on success, -1 if memory allocation fails.
+ */
+static int dotenv_lazy_push(dotenv_lazy_frame **frames, int *capacity,
+                            int *depth, const env_var *var) {
+  if (*depth == *capacity) {
+    int new_capacity = *capacity ? *capacity * 2 : 16;
+    dotenv_lazy_frame *new_frames =
+        realloc(*frames, sizeof(dotenv_lazy_frame) * new_capacity);
+
+    if (!new_frames) {
+      perror("Failed to allocate memory for interpolation.");
+      return -1;
+    }
+
+    *frames = new_frames;
+    *capacity = new_capacity;
+  }
+
+  var->cache->visiting = 1;
+  (*frames)[(*depth)++] =
+      (dotenv_lazy_frame){var, var->raw, var->raw + var->raw_len};
+
+  return 0;
+}
+
+/**
+ * @brief Expands a lazy value and every lazy value it refers to.
+ *
+ * The caller must hold `ctx.mutex`. References are followed depth-first with
+ * an explicit stack, as in `dotenv_resolve_table`. Each expansion is copied
+ * into the context's arena and published with release ordering, so it is
+ * computed once. A cycle is reported with the keys involved, and every value
+ * depending on it is marked as unresolved.
+ *
+ * @param var The lazy value.
+ * @return The expanded value, or NULL on a reference cycle or if memory
+ * allocation fails.
+ */
+static const char *dotenv_expand_locked(const env_var *var) {
+  const char *ready = dotenv_var_ready(var);
+
+  if (ready)
+    return ready != dotenv_unresolved ? ready : NULL;
+
+  dotenv_buffer scratch = {NULL, 0, 0};
+  dotenv_lazy_frame *frames = NULL;
+  int capacity = 0;
+  int depth = 0;
+  int cyclic = 0;
+  const char *result = NULL;
+
+  if (dotenv_lazy_push(&frames, &capacity, &depth, var) == -1)
+    goto done;
+
+  while (depth > 0) {
+    dotenv_lazy_frame *frame = &frames[depth - 1];
+    const char *start;
+    dotenv_span name;
+
+    if (dotenv_next_placeholder(frame->cursor, frame->end, &start, &name)) {
+      frame->cursor = name.ptr + name.len + 1;
+
+      const env_var *target = dotenv_lazy_target(frame->var, name);
+
+      if (!target)
+        continue;
+
+      ready = dotenv_var_ready(target);
+
+      if (ready == dotenv_unresolved || (!ready && target->cache->visiting)) {
+        fprintf(stderr, "Cyclic variable reference: ");
+
+        for (int i = 0; i < depth; i++) {
+          fprintf(stderr, "%s -> ", frames[i].var->key);
+        }
+
+        fprintf(stderr, "%s\n", target->key);
+        cyclic = 1;
+        goto done;
+      }
+
+      if (!ready &&
+          dotenv_lazy_push(&frames, &capacity, &depth, target) == -1)
+        goto done;
+
+      continue;
+    }
+
+    // Everything the value refers to is expanded
+    const char *current = frame->var->raw;
+
+    scratch.length = 0;
+
+    for (;;) {
+      int found = dotenv_next_placeholder(current, frame->end, &start, &name);
+
+      if (dotenv_buffer_append(&scratch, current, start - current) == -1) {
+        perror("Failed to allocate memory for interpolation.");
+        goto done;
+      }
+
+      if (!found)
+        break;
+
+      const env_var *target = dotenv_lazy_target(frame->var, name);
+      const char *value = target ? dotenv_var_ready(target) : NULL;
+
+      if (value && dotenv_buffer_append(&scratch, value,
+                                        dotenv_var_length(target)) == -1) {
+        perror("Failed to allocate memory for interpolation.");
+        goto done;
+      }
+
+      current = name.ptr + name.len + 1;
+    }
+
+    dotenv_span expanded = {scratch.data, scratch.length};
+    char *copy = dotenv_arena_strndup(&ctx.arena, expanded);
+
+    if (!copy) {
+      perror("Failed to allocate memory for key or value.");
+      goto done;
+    }
+
+    frame->var->cache->visiting = 0;
+    frame->var->cache->expanded_len = scratch.length;
+    atomic_store_explicit(&frame->var->cache->expanded, copy,
+                          memory_order_release);
+    result = copy;
+    depth--;
+  }
+
+done:
+  // Whatever is left on the stack depends on a cycle or failed to expand
+  for (int i = 0; i < depth; i++) {
+    frames[i].var->cache->visiting = 0;
+
+    if (cyclic) {
+      atomic_store_explicit(&frames[i].var->cache->expanded, dotenv_unresolved,
+                            memory_order_release);
+    }
+  }
+
+  free(frames);
+  free(scratch.data);
+  return depth == 0 ? result : NULL;
+}
+
+/**
+ * @brief Returns the value of an entry, expanding it on first use if lazy.
+ *
+ * Only the first read of a lazy value takes `ctx.mutex`; later reads load the
+ * cached expansion.
+ *
+ * @param var The entry.
+ * @return The value, or NULL if it depends on a reference cycle or cannot be
+ * expanded.
+ */
+static const char *dotenv_var_value(const env_var *var) {
+  const char *value = dotenv_var_ready(var);
+
+  if (value)
+    return value != dotenv_unresolved ? value : NULL;
+
+  pthread_mutex_lock(&ctx.mutex);
+  value = dotenv_expand_locked(var);
+  pthread_mutex_unlock(&ctx.mutex);
+
+  return value;
+}
+
+/**
+ * @brief Looks up a key in a frozen table.
+ *
+ * @param frozen The frozen table.
+ * @param key The key to search for.
+ * @param len The length of the key in bytes.
+ * @param hash The hash of `key`.
+ * @return The entry of the key, or NULL if not found.
+ */
+static const dotenv_frozen_entry *
+dotenv_frozen_find(const dotenv_frozen *frozen, const char *key, size_t len,
+                   uint64_t hash) {
+  const dotenv_phash *phash = &frozen->phash;
+
+  if (phash->count == 0)
+    return NULL;
+
+  const dotenv_frozen_entry *entry = &frozen->entries[dotenv_phash_find(
+      hash, phash->count, phash->slot_count, phash->bucket_count, phash->seeds,
+      phash->remap)];
+
+  if (entry->hash != hash || entry->key_len != len ||
+      memcmp(entry->key, key, len) != 0)
+    return NULL;
+
+  return entry;
+}
+
+/// Key whose destructor gives a thread's reader slot back when it exits.
+static pthread_key_t dotenv_reader_key;
+
+/// Creates `dotenv_reader_key` once.
+static pthread_once_t dotenv_reader_key_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Gives the reader slot of an exiting thread back.
+ *
+ * @param reader The slot.
+ */
+static void dotenv_reader_release(void *reader) {
+  atomic_store_explicit(&((dotenv_reader *)reader)->owned, 0,
+                        memory_order_release);
+}
+
+/**
+ * @brief Creates the key releasing reader slots.
+ */
+static void dotenv_reader_key_create(void) {
+  pthread_key_create(&dotenv_reader_key, dotenv_reader_release);
+}
+
+/**
+ * @brief Finds a reader slot for the calling thread.
+ *
+ * Takes a slot given back by a thread that exited, or registers a new one.
+ * Two threads ending up on one slot is only slower, since the counters are
+ * atomic.
+ *
+ * @return The slot, or the shared slot if memory allocation fails.
+ */
+static dotenv_reader *dotenv_reader_register(void) {
+  dotenv_reader *reader = atomic_load(&ctx.readers);
+
+  for (; reader; reader = reader->next) {
+    int owned = 0;
+
+    if (atomic_compare_exchange_strong(&reader->owned, &owned, 1))
+      break;
+  }
+
+  if (!reader) {
+    reader = aligned_alloc(_Alignof(dotenv_reader), sizeof(dotenv_reader));
+
+    if (!reader)
+      return &ctx.shared_reader;
+
+    atomic_init(&reader->count[0], 0);
+    atomic_init(&reader->count[1], 0);
+    atomic_init(&reader->owned, 1);
+    reader->next = atomic_load(&ctx.readers);
+
+    while (!atomic_compare_exchange_weak(&ctx.readers, &reader->next, reader))
+      ;
+  }
+
+  pthread_once(&dotenv_reader_key_once, dotenv_reader_key_create);
+  pthread_setspecific(dotenv_reader_key, reader);
+  return reader;
+}
+
+/**
+ * @brief Announces that the calling thread is about to read the tables.
+ *
+ * The thread counts itself under the current epoch's parity in its own slot,
+ * so concurrent readers never write to the same cache line. Tables retired
+ * from now on are kept until the matching `dotenv_read_end`, see
+ * `dotenv_reclaim`. Calls may nest.
+ *
+ * @return The counter to pass to `dotenv_read_end`.
+ */
+static _Atomic long *dotenv_read_begin(void) {
+  static _Thread_local dotenv_reader *reader;
+
+  if (!reader) {
+    reader = dotenv_reader_register();
+  }
+
+  unsigned long epoch = atomic_load(&ctx.epoch);
+  _Atomic long *count = &reader->count[epoch & 1];
+
+  // Ordered before the table is loaded, so dotenv_reclaim sees the reader
+  atomic_fetch_add(count, 1);
+  return count;
+}
+
+/**
+ * @brief Ends a read started by `dotenv_read_begin`.
+ *
+ * May be called from another thread, as when a cursor is closed there.
+ *
+ * @param count The counter it returned.
+ */
+static void dotenv_read_end(_Atomic long *count) {
+  atomic_fetch_sub_explicit(count, 1, memory_order_release);
+}
+
+const char *dotenv_get(const char *key) {
+  const char *value;
+  size_t len;
+
+  return dotenv_get_view(key, &value, &len) == 0 ? value : NULL;
+}
+
+int dotenv_get_view(const char *key, const char **value, size_t *len) {
+  const dotenv_frozen *frozen =
+      atomic_load_explicit(&ctx.frozen, memory_order_acquire);
+  size_t key_len = strlen(key);
+  uint64_t hash = dotenv_hash(key, key_len);
+
+  *value = NULL;
+  *len = 0;
+
+  if (frozen) {
+    const dotenv_frozen_entry *entry =
+        dotenv_frozen_find(frozen, key, key_len, hash);
+
+    if (!entry || !entry->value)
+      return -1;
+
+    *value = entry->value;
+    *len = entry->value_len;
+    return 0;
+  }
+
+  _Atomic long *pin = dotenv_read_begin();
+  const dotenv_table *table = atomic_load(&ctx.table);
+  int pos = dotenv_index_find(table, key, key_len, hash);
+  int result = -1;
+
+  if (pos != -1) {
+    const env_var *var = &table->vars[pos];
+
+    *value = dotenv_var_value(var);
+
+    if (*value) {
+      *len = dotenv_var_length(var);
+      result = 0;
+    }
+  }
+
+  dotenv_read_end(pin);
+  return result;
+}
+
+/**
+ * @struct dotenv_sorted_key
+ * @brief Key being sorted by `dotenv_table_order`.
+ */
+typedef struct {
+  const char *key; ///< The key.
+  size_t len;      ///< Length of the key.
+  int pos;         ///< Position of its entry in the table.
+} dotenv_sorted_key;
+
+/**
+ * @brief Orders two keys bytewise, a key before the longer keys it prefixes.
+ *
+ * @param a The first key.
+ * @param a_len Its length.
+ * @param b The second key.
+ * @param b_len Its length.
+ * @return A negative, zero or positive number as `a` sorts before, equal to
+ * or after `b`.
+ */
+static int dotenv_key_compare(const char *a, size_t a_len, const char *b,
+                              size_t b_len) {
+  int order = memcmp(a, b, a_len < b_len ? a_len : b_len);
+
+  if (order != 0)
+    return order;
+
+  return (a_len > b_len) - (a_len < b_len);
+}
+
+/**
+ * @brief Orders sorted keys for `qsort`.
+ */
+static int dotenv_sorted_key_compare(const void *a, const void *b) {
+  const dotenv_sorted_key *x = a;
+  const dotenv_sorted_key *y = b;
+
+  return dotenv_key_compare(x->key, x->len, y->key, y->len);
+}
+
+/**
+ * @brief Returns the entries of a table in key order, sorting them on first
+ * use.
+ *
+ * The order is built without a lock the first time a table is queried and
+ * installed with a compare-and-swap, so concurrent queries may both sort but
+ * only one result is kept. It then lives as long as the table.
+ *
+ * @param table The published table.
+ * @return The order, or NULL if memory allocation fails.
+ */
+static const dotenv_order *dotenv_table_order(dotenv_table *table) {
+  dotenv_order *order =
+      atomic_load_explicit(&table->order, memory_order_acquire);
+
+  if (order)
+    return order;
+
+  int capacity = table->var_count > 0 ? table->var_count : 1;
+  dotenv_sorted_key *keys = malloc(sizeof(dotenv_sorted_key) * capacity);
+
+  order = malloc(sizeof(dotenv_order) + sizeof(int) * capacity);
+
+  if (!keys || !order) {
+    perror("Failed to allocate memory for the key order.");
+    free(keys);
+    free(order);
+    return NULL;
+  }
+
+  order->count = 0;
+
+  // Only the definitions the index finds are visible
+  for (int i = 0; i < table->var_count; i++) {
+    const env_var *var = &table->vars[i];
+
+    if (dotenv_index_find(table, var->key, var->key_len, var->hash) == i) {
+      keys[order->count++] = (dotenv_sorted_key){var->key, var->key_len, i};
+    }
+  }
+
+  qsort(keys, order->count, sizeof(dotenv_sorted_key),
+        dotenv_sorted_key_compare);
+
+  for (int i = 0; i < order->count; i++) {
+    order->positions[i] = keys[i].pos;
+  }
+
+  free(keys);
+
+  dotenv_order *expected = NULL;
+
+  if (!atomic_compare_exchange_strong_explicit(&table->order, &expected, order,
+                                               memory_order_acq_rel,
+                                               memory_order_acquire)) {
+    free(order);
+    order = expected;
+  }
+
+  return order;
+}
+
+/**
+ * @brief Finds where keys starting with a prefix begin or end in key order.
+ *
+ * @param table The table.
+ * @param order Its key order.
+ * @param prefix The prefix.
+ * @param len The length of the prefix.
+ * @param after 0 to find the first key with the prefix, 1 to find the first
+ * key after them.
+ * @return The position in `order->positions`.
+ */
+static int dotenv_order_bound(const dotenv_table *table,
+                              const dotenv_order *order, const char *prefix,
+                              size_t len, int after) {
+  int low = 0;
+  int high = order->count;
+
+  while (low < high) {
+    int mid = low + (high - low) / 2;
+    const env_var *var = &table->vars[order->positions[mid]];
+    size_t key_len = var->key_len < len ? var->key_len : len;
+
+    // Keys are compared on their first `len` bytes only
+    int cmp = dotenv_key_compare(var->key, key_len, prefix, len);
+
+    if (cmp < 0 || (after && cmp == 0)) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  return low;
+}
+
+int dotenv_cursor_open(dotenv_cursor *cursor, const char *prefix) {
+  _Atomic long *pin = dotenv_read_begin();
+  dotenv_table *table = atomic_load(&ctx.table);
+
+  cursor->table = table;
+  cursor->next = 0;
+  cursor->end = 0;
+  cursor->pin = NULL;
+
+  if (!table) {
+    dotenv_read_end(pin);
+    return 0;
+  }
+
+  const dotenv_order *order = dotenv_table_order(table);
+
+  if (!order) {
+    dotenv_read_end(pin);
+    return -1;
+  }
+
+  size_t len = strlen(prefix);
+
+  cursor->next = dotenv_order_bound(table, order, prefix, len, 0);
+  cursor->end = dotenv_order_bound(table, order, prefix, len, 1);
+
+  if (cursor->next < cursor->end) {
+    cursor->pin = (void *)pin;
+  } else {
+    dotenv_read_end(pin);
+  }
+
+  return 0;
+}
+
+int dotenv_cursor_next(dotenv_cursor *cursor, const char **key,
+                       const char **value) {
+  const dotenv_table *table = cursor->table;
+
+  while (cursor->next < cursor->end) {
+    const dotenv_order *order =
+        atomic_load_explicit(&table->order, memory_order_acquire);
+    const env_var *var = &table->vars[order->positions[cursor->next++]];
+    const char *resolved = dotenv_var_value(var);
+
+    // Like dotenv_get, values depending on a cycle are not found
+    if (resolved) {
+      *key = var->key;
+      *value = resolved;
+      return 0;
+    }
+  }
+
+  dotenv_cursor_close(cursor);
+  return -1;
+}
+
+void dotenv_cursor_close(dotenv_cursor *cursor) {
+  if (cursor->pin) {
+    dotenv_read_end((_Atomic long *)cursor->pin);
+    cursor->pin = NULL;
+  }
+
+  cursor->next = cursor->end;
+}
+
+int dotenv_foreach_prefix(const char *prefix, dotenv_visitor visit,
+                          void *user) {
+  dotenv_cursor cursor;
+  const char *key;
+  const char *value;
+
+  if (dotenv_cursor_open(&cursor, prefix) == -1)
+    return -1;
+
+  while (dotenv_cursor_next(&cursor, &key, &value) == 0) {
+    if (visit(key, value, user) != 0)
+      break;
+  }
+
+  dotenv_cursor_close(&cursor);
+  return 0;
+}
+
+/**
+ * @brief Returns the value of an entry of a loaded table with its length.
+ *
+ * @param table The table.
+ * @param pos The position of the entry, or -1.
+ * @param len Receives the length of the value, or 0.
+ * @return The value, or NULL if `pos` is -1 or the value is missing.
+ */
+static const char *dotenv_resolver_value(const dotenv_table *table, int pos,
+                                         size_t *len) {
+  const char *value = pos != -1 ? dotenv_var_value(&table->vars[pos]) : NULL;
+
+  *len = value ? dotenv_var_length(&table->vars[pos]) : 0;
+  return value;
+}
+
+/**
+ * @brief Finds what a placeholder in an entry of the new table refers to.
+ *
+ * The table that will win once the two are merged is searched first. A
+ * placeholder naming its own entry refers to the previous definition: the
+ * definition it overrides in the same table if any, then the one in the
+ * environment snapshot loaded with the file, then by default the one in the
+ * published table, so `PATH=${PATH}:/opt/bin` extends the loaded value.
+ *
+ * @param resolver The interpolation state.
+ * @param self The position of the entry holding the placeholder.
+ * @param name The placeholder name.
+ * @param pos Receives the position of the referenced entry of the new table,
+ * or -1 if the placeholder does not refer to the new table.
+ * @param len Receives the length of the returned value, or 0.
+ * @return The value from the published table when `pos` is -1, or NULL.
+ */
+static const char *dotenv_resolver_target(const dotenv_resolver *resolver,
+                                          int self, dotenv_span name,
+                                          int *pos, size_t *len) {
+  uint64_t hash = dotenv_hash(name.ptr, name.len);
+  int own = dotenv_index_find(resolver->table, name.ptr, name.len, hash);
+  int base_pos = dotenv_index_find(resolver->base, name.ptr, name.len, hash);
+
+  if (base_pos != -1 &&
+      dotenv_index_find(resolver->drop, name.ptr, name.len, hash) != -1) {
+    base_pos = -1;
+  }
+
+  // Overridden definitions are not indexed, so their key finds the winner
+  const env_var *entry = &resolver->table->vars[self];
+  int own_key = own == self ||
+                (resolver->below && own != -1 && entry->hash == hash &&
+                 entry->key_len == name.len &&
+                 memcmp(entry->key, name.ptr, name.len) == 0);
+
+  if (own_key && resolver->below && resolver->below[self] != -1) {
+    *pos = resolver->below[self];
+    *len = 0;
+    return NULL;
+  }
+
+  if (own_key) {
+    const dotenv_table *previous = resolver->environment;
+    int previous_pos = dotenv_index_find(previous, name.ptr, name.len, hash);
+
+    if (previous_pos == -1) {
+      previous = resolver->previous;
+      previous_pos = dotenv_index_find(previous, name.ptr, name.len, hash);
+    }
+
+    *pos = -1;
+    return dotenv_resolver_value(previous, previous_pos, len);
+  }
+
+  if (own != -1 && (resolver->table_wins || base_pos == -1)) {
+    *pos = own;
+    *len = 0;
+    return NULL;
+  }
+
+  *pos = -1;
+  return dotenv_resolver_value(resolver->base, base_pos, len);
+}
+
+/**
+ * @brief Replaces occurrences of `${var}` in an entry's raw value with their
+ * corresponding values.
+ *
+ * Every entry referenced by the value must already be resolved. The input is
+ * scanned once and copied in spans, so the cost is linear in the length of
+ * the input plus the length of the output. A value without placeholders is
+ * returned as is; others are expanded in a scratch buffer that is reused
+ * across calls and then stored in the arena.
+ *
+ * @param resolver The interpolation state.
+ * @param self The position of the entry in the new table.
+ * @param len Receives the length of the resolved string.
+ * @return The resolved string, or NULL on error.
+ */
+static char *resolve_variables(dotenv_resolver *resolver, int self,
+                               size_t *len) {
+  const env_var *var = &resolver->table->vars[self];
+  char *raw = var->raw;
+  dotenv_buffer *scratch = &resolver->scratch;
+  const char *current = raw;
+  const char *end = raw + var->raw_len;
+
+  if (!memchr(raw, '$', end - raw)) {
+    *len = var->raw_len;
+    return raw;
+  }
+
+  scratch->length = 0;
+
+  for (;;) {
+    const char *start;
+    dotenv_span name;
+    int found = dotenv_next_placeholder(current, end, &start, &name);
+
+    if (dotenv_buffer_append(scratch, current, start - current) == -1)
+      return NULL;
+
+    if (!found)
+      break;
+
+    // Lookup the variable value
+    int pos;
+    size_t value_len;
+    const char *value =
+        dotenv_resolver_target(resolver, self, name, &pos, &value_len);
+
+    if (pos != -1) {
+      value = resolver->table->vars[pos].value;
+      value_len = resolver->table->vars[pos].value_len;
+    }
+
+    if (value && dotenv_buffer_append(scratch, value, value_len) == -1)
+      return NULL;
+
+    current = name.ptr + name.len + 1;
+  }
+
+  dotenv_span expanded = {scratch->data, scratch->length};
+
+  *len = scratch->length;
+  return dotenv_arena_strndup(resolver->arena, expanded);
+}
+
+/**
+ * @struct dotenv_resolve_frame
+ * @brief Entry on the depth-first stack of `dotenv_resolve_table`.
+ */
+typedef struct {
+  int entry;          ///< Position of the entry in the new table.
+  const char *cursor; ///< Where to look for its next placeholder.
+  const char *end;    ///< One past the last byte of its raw value.
+} dotenv_resolve_frame;
+
+/// Entry not visited yet.
+#define DOTENV_RESOLVE_NEW 0
+
+/// Entry whose references are being resolved.
+#define DOTENV_RESOLVE_ACTIVE 1
+
+/// Entry whose value is resolved.
+#define DOTENV_RESOLVE_DONE 2
+
+/**
+ * @brief Reports a reference cycle found on the resolution stack.
+ *
+ * @param table The table being resolved.
+ * @param frames The resolution stack.
+ * @param depth The number of frames on the stack.
+ * @param entry The entry closing the cycle.
+ */
+static void dotenv_report_cycle(const dotenv_table *table,
+                                const dotenv_resolve_frame *frames, int depth,
+                                int entry) {
+  int first = depth - 1;
+
+  while (first > 0 && frames[first].entry != entry) {
+    first--;
+  }
+
+  fprintf(stderr, "Cyclic variable reference: ");
+
+  for (int i = first; i < depth; i++) {
+    fprintf(stderr, "%s -> ", table->vars[frames[i].entry].key);
+  }
+
+  fprintf(stderr, "%s\n", table->vars[entry].key);
+}
+
+/**
+ * @brief Interpolates every value of a freshly parsed table.
+ *
+ * Placeholders may refer to entries defined anywhere in the table. The
+ * references form a graph that is walked depth-first with an explicit stack,
+ * so each entry is resolved once, after everything it refers to, and each
+ * placeholder is looked at a constant number of times. A reference back to an
+ * entry still on the stack is a cycle; it is reported with the keys involved
+ * and nothing is resolved. Entries that already hold a value, kept from a
+ * previous load of the same file, are used as is.
+ *
+ * Lazy values are only checked: the walk then starts from the entries that
+ * are new, follows what they refer to, and stores nothing.
+ *
+ * @param resolver The interpolation state.
+ * @param roots Marks the new lazy entries to check, or NULL to resolve every
+ * entry.
+ * @return 0 on success, -1 on a reference cycle or if memory allocation fails.
+ */
+static int dotenv_resolve_table(dotenv_resolver *resolver,
+                                const unsigned char *roots) {
+  dotenv_table *table = (dotenv_table *)resolver->table;
+  int count = table->var_count;
+  unsigned char *state = calloc(count ? count : 1, 1);
+  dotenv_resolve_frame *frames =
+      malloc(sizeof(dotenv_resolve_frame) * (count ? count : 1));
+  int result = -1;
+
+  if (!state || !frames) {
+    perror("Failed to allocate memory for interpolation.");
+    goto done;
+  }
+
+  for (int i = 0; i < count; i++) {
+    if (table->vars[i].value) {
+      state[i] = DOTENV_RESOLVE_DONE;
+    }
+  }
+
+  for (int i = 0; i < count; i++) {
+    if (state[i] != DOTENV_RESOLVE_NEW || (roots && !roots[i]))
+      continue;
+
+    int depth = 0;
+    const env_var *var = &table->vars[i];
+
+    state[i] = DOTENV_RESOLVE_ACTIVE;
+    frames[depth++] =
+        (dotenv_resolve_frame){i, var->raw, var->raw + var->raw_len};
+
+    while (depth > 0) {
+      dotenv_resolve_frame *frame = &frames[depth - 1];
+      const char *start;
+      dotenv_span name;
+
+      if (!dotenv_next_placeholder(frame->cursor, frame->end, &start, &name)) {
+        // Everything the entry refers to is resolved
+        env_var *resolved = &table->vars[frame->entry];
+
+        if (!roots) {
+          resolved->value =
+              resolve_variables(resolver, frame->entry, &resolved->value_len);
+        }
+
+        if (!roots && !resolved->value) {
+          perror("Failed to allocate memory for key or value.");
+          goto done;
+        }
+
+        state[frame->entry] = DOTENV_RESOLVE_DONE;
+        depth--;
+        continue;
+      }
+
+      frame->cursor = name.ptr + name.len + 1;
+
+      int pos;
+      size_t value_len;
+      dotenv_resolver_target(resolver, frame->entry, name, &pos, &value_len);
+
+      if (pos == -1 || state[pos] == DOTENV_RESOLVE_DONE)
+        continue;
+
+      if (state[pos] == DOTENV_RESOLVE_ACTIVE) {
+        dotenv_report_cycle(table, frames, depth, pos);
+        goto done;
+      }
+
+      var = &table->vars[pos];
+      state[pos] = DOTENV_RESOLVE_ACTIVE;
+      frames[depth++] =
+          (dotenv_resolve_frame){pos, var->raw, var->raw + var->raw_len};
+    }
+  }
+
+  result = 0;
+
+done:
+  free(state);
+  free(frames);
+  return result;
+}
+
+/**
+ * @brief Returns the slot addressed by a handle.
+ *
+ * @param handle The handle (must be below `ctx.slot_count`).
+ * @return The slot.
+ */
+static dotenv_slot *dotenv_slot_at(dotenv_handle handle) {
+  dotenv_slot *chunk = atomic_load_explicit(
+      &ctx.slot_chunks[handle / DOTENV_SLOT_CHUNK_SIZE], memory_order_acquire);
+
+  return &chunk[handle % DOTENV_SLOT_CHUNK_SIZE];
+}
+
+/**
+ * @brief Points a slot at the value of its key in a table.
+ *
+ * A lazy value is expanded right away, as interned keys are the ones a program
+ * reads. The caller must hold `ctx.mutex`.
+ *
+ * @param slot The slot to update.
+ * @param table The table to look the key up in (may be NULL).
+ */
+static void dotenv_slot_refresh(dotenv_slot *slot, const dotenv_table *table) {
+  int pos = dotenv_index_find(table, slot->key, strlen(slot->key), slot->hash);
+
+  atomic_store_explicit(
+      &slot->value, pos != -1 ? dotenv_expand_locked(&table->vars[pos]) : NULL,
+      memory_order_release);
+}
+
+/**
+ * @brief Looks up the handle of an interned key.
+ *
+ * The caller must hold `ctx.mutex`.
+ *
+ * @param key The key to search for.
+ * @param hash The hash of `key`.
+ * @return The handle, or `DOTENV_INVALID_HANDLE` if the key is not interned.
+ */
+static dotenv_handle dotenv_slot_find(const char *key, uint64_t hash) {
+  if (!ctx.slot_index)
+    return DOTENV_INVALID_HANDLE;
+
+  size_t mask = (size_t)ctx.slot_index_capacity - 1;
+
+  for (size_t i = (size_t)hash & mask;; i = (i + 1) & mask) {
+    dotenv_handle handle = ctx.slot_index[i];
+
+    if (handle == DOTENV_INVALID_HANDLE)
+      return DOTENV_INVALID_HANDLE;
+
+    dotenv_slot *slot = dotenv_slot_at(handle);
+
+    if (slot->hash == hash && strcmp(slot->key, key) == 0)
+      return handle;
+  }
+}
+
+/**
+ * @brief Adds a handle to the slot index, growing it to stay half empty.
+ *
+ * The caller must hold `ctx.mutex`.
+ *
+ * @param handle The handle of the newly interned key.
+ * @return 0 on success, -1 if memory allocation fails.
+ */
+static int dotenv_slot_index_insert(dotenv_handle handle) {
+  if ((handle + 1) * 2 > ctx.slot_index_capacity) {
+    int new_capacity = dotenv_index_capacity_for(handle + 1);
+    int *new_index = malloc(sizeof(int) * new_capacity);
+
+    if (!new_index) {
+      perror("Failed to allocate memory for the handle index.");
+      return -1;
+    }
+
+    memset(new_index, -1, sizeof(int) * new_capacity);
+    free(ctx.slot_index);
+
+    ctx.slot_index = new_index;
+    ctx.slot_index_capacity = new_capacity;
+
+    // Re-add every earlier handle, the new one is placed below
+    for (dotenv_handle h = 0; h < handle; h++) {
+      size_t mask = (size_t)new_capacity - 1;
+      size_t i = (size_t)dotenv_slot_at(h)->hash & mask;
+
+      while (ctx.slot_index[i] != DOTENV_INVALID_HANDLE) {
+        i = (i + 1) & mask;
+      }
+
+      ctx.slot_index[i] = h;
+    }
+  }
+
+  size_t mask = (size_t)ctx.slot_index_capacity - 1;
+  size_t i = (size_t)dotenv_slot_at(handle)->hash & mask;
+
+  while (ctx.slot_index[i] != DOTENV_INVALID_HANDLE) {
+    i = (i + 1) & mask;
+  }
+
+  ctx.slot_index[i] = handle;
+
+  return 0;
+}
+
+dotenv_handle dotenv_intern(const char *key) {
+  size_t len = strlen(key);
+  uint64_t hash = dotenv_hash(key, len);
+
+  pthread_mutex_lock(&ctx.mutex);
+
+  dotenv_handle handle = dotenv_slot_find(key, hash);
+
+  if (handle != DOTENV_INVALID_HANDLE) {
+    pthread_mutex_unlock(&ctx.mutex);
+    return handle;
+  }
+
+  if (ctx.slot_count >= DOTENV_SLOT_CHUNK_SIZE * DOTENV_SLOT_CHUNKS) {
+    fprintf(stderr, "Too many interned keys.\n");
+    pthread_mutex_unlock(&ctx.mutex);
+    return DOTENV_INVALID_HANDLE;
+  }
+
+  handle = ctx.slot_count;
+
+  _Atomic(dotenv_slot *) *chunk =
+      &ctx.slot_chunks[handle / DOTENV_SLOT_CHUNK_SIZE];
+
+  if (!atomic_load_explicit(chunk, memory_order_relaxed)) {
+    dotenv_slot *slots = calloc(DOTENV_SLOT_CHUNK_SIZE, sizeof(dotenv_slot));
+
+    if (!slots) {
+      perror("Failed to allocate memory for interned keys.");
+      pthread_mutex_unlock(&ctx.mutex);
+      return DOTENV_INVALID_HANDLE;
+    }
+
+    atomic_store_explicit(chunk, slots, memory_order_release);
+  }
+
+  dotenv_slot *slot = dotenv_slot_at(handle);
+  dotenv_span key_span = {key, len};
+
+  slot->key = dotenv_arena_strndup(&ctx.arena, key_span);
+  slot->hash = hash;
+
+  if (!slot->key || dotenv_slot_index_insert(handle) == -1) {
+    perror("Failed to allocate memory for interned key.");
+    pthread_mutex_unlock(&ctx.mutex);
+    return DOTENV_INVALID_HANDLE;
+  }
+
+  dotenv_slot_refresh(slot,
+                      atomic_load_explicit(&ctx.table, memory_order_relaxed));
+  ctx.slot_count++;
+
+  pthread_mutex_unlock(&ctx.mutex);
+  return handle;
+}
+
+const char *dotenv_get_h(dotenv_handle handle) {
+  if (handle < 0 || handle >= DOTENV_SLOT_CHUNK_SIZE * DOTENV_SLOT_CHUNKS)
+    return NULL;
+
+  dotenv_slot *chunk = atomic_load_explicit(
+      &ctx.slot_chunks[handle / DOTENV_SLOT_CHUNK_SIZE], memory_order_acquire);
+
+  if (!chunk)
+    return NULL;
+
+  return atomic_load_explicit(&chunk[handle % DOTENV_SLOT_CHUNK_SIZE].value,
+                              memory_order_acquire);
+}
+
+/// Cache type of `dotenv_get_int64`.
+#define DOTENV_TYPE_INT64 2
+
+/// Cache type of `dotenv_get_bool`.
+#define DOTENV_TYPE_BOOL 3
+
+/// Cache type of `dotenv_get_double`.
+#define DOTENV_TYPE_DOUBLE 4
+
+/// Cache type of `dotenv_get_duration_ns`.
+#define DOTENV_TYPE_DURATION 5
+
+/// Cache type of `dotenv_get_bytes`.
+#define DOTENV_TYPE_BYTES 6
+
+/// Converts a value into the 64-bit representation of a typed result.
+typedef int (*dotenv_parser)(const char *value, uint64_t *bits);
+
+/**
+ * @brief Compares a string with a lowercase word, ignoring case.
+ *
+ * @param str The string to compare.
+ * @param word The lowercase word.
+ * @param len The number of bytes of `str` to compare.
+ * @return 1 if the first `len` bytes of `str` spell exactly `word`.
+ */
+static int dotenv_equals_word(const char *str, const char *word, size_t len) {
+  if (strlen(word) != len)
+    return 0;
+
+  for (size_t i = 0; i < len; i++) {
+    char c = str[i];
+
+    if (c >= 'A' && c <= 'Z') {
+      c = (char)(c - 'A' + 'a');
+    }
+
+    if (c != word[i])
+      return 0;
+  }
+
+  return 1;
+}
+
+/**
+ * @brief Parses a signed decimal integer.
+ */
+static int dotenv_parse_int64(const char *value, uint64_t *bits) {
+  char *end;
+
+  errno = 0;
+  long long number = strtoll(value, &end, 10);
+
+  if (end == value || *end != '\0' || errno == ERANGE)
+    return -1;
+
+  *bits = (uint64_t)(int64_t)number;
+  return 0;
+}
+
+/**
+ * @brief Parses a boolean word or digit.
+ */
+static int dotenv_parse_bool(const char *value, uint64_t *bits) {
+  static const char *const truthy[] = {"true", "yes", "on", "1"};
+  static const char *const falsy[] = {"false", "no", "off", "0"};
+  size_t len = strlen(value);
+
+  for (size_t i = 0; i < sizeof(truthy) / sizeof(truthy[0]); i++) {
+    if (dotenv_equals_word(value, truthy[i], len)) {
+      *bits = 1;
+      return 0;
+    }
+
+    if (dotenv_equals_word(value, falsy[i], len)) {
+      *bits = 0;
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+/**
+ * @brief Parses a floating-point number.
+ */
+static int dotenv_parse_double(const char *value, uint64_t *bits) {
+  char *end;
+
+  errno = 0;
+  double number = strtod(value, &end);
+
+  if (end == value || *end != '\0' || errno == ERANGE)
+    return -1;
+
+  memcpy(bits, &number, sizeof(number));
+  return 0;
+}
+
+/**
+ * @brief Parses an unsigned number with an optional fraction.
+ *
+ * @param cursor Start of the number; advanced past it.
+ * @param whole Receives the integer part.
+ * @param fraction Receives the fractional part.
+ * @return 0 on success, -1 if there is no number or it overflows.
+ */
+static int dotenv_parse_number(const char **cursor, uint64_t *whole,
+                               double *fraction) {
+  const char *p = *cursor;
+  double scale = 0.1;
+
+  *whole = 0;
+  *fraction = 0.0;
+
+  while (*p >= '0' && *p <= '9') {
+    if (*whole > (UINT64_MAX - (uint64_t)(*p - '0')) / 10)
+      return -1;
+
+    *whole = *whole * 10 + (uint64_t)(*p - '0');
+    p++;
+  }
+
+  if (*p == '.') {
+    p++;
+
+    while (*p >= '0' && *p <= '9') {
+      *fraction += (*p - '0') * scale;
+      scale /= 10;
+      p++;
+    }
+  }
+
+  if (p == *cursor || (p - *cursor == 1 && **cursor == '.'))
+    return -1;
+
+  *cursor = p;
+  return 0;
+}
+
+/**
+ * @brief Scales a parsed number by a unit, checking for overflow.
+ *
+ * @param whole The integer part.
+ * @param fraction The fractional part.
+ * @param unit The multiplier.
+ * @param limit The largest acceptable result.
+ * @param out Receives the scaled number.
+ * @return 0 on success, -1 if the result exceeds `limit`.
+ */
+static int dotenv_scale(uint64_t whole, double fraction, uint64_t unit,
+                        uint64_t limit, uint64_t *out) {
+  if (whole > limit / unit)
+    return -1;
+
+  uint64_t scaled = whole * unit;
+  uint64_t extra = (uint64_t)(fraction * (double)unit);
+
+  if (extra > limit - scaled)
+    return -1;
+
+  *out = scaled + extra;
+  return 0;
+}
+
+/**
+ * @brief Parses a duration such as `1h30m` or `250ms` into nanoseconds.
+ */
+static int dotenv_parse_duration(const char *value, uint64_t *bits) {
+  static const struct {
+    const char *name;
+    uint64_t ns;
+  } units[] = {{"ns", 1ULL},          {"us", 1000ULL},
+               {"ms", 1000000ULL},    {"s", 1000000000ULL},
+               {"m", 60000000000ULL}, {"h", 3600000000000ULL}};
+  const char *p = value;
+  int negative = *p == '-';
+  uint64_t total = 0;
+
+  if (negative || *p == '+') {
+    p++;
+  }
+
+  if (strcmp(p, "0") == 0) {
+    *bits = 0;
+    return 0;
+  }
+
+  if (*p == '\0')
+    return -1;
+
+  while (*p) {
+    uint64_t whole, scaled;
+    double fraction;
+
+    if (dotenv_parse_number(&p, &whole, &fraction) == -1)
+      return -1;
+
+    const char *unit = p;
+
+    while ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z')) {
+      p++;
+    }
+
+    size_t i = 0;
+    size_t count = sizeof(units) / sizeof(units[0]);
+
+    while (i < count && !dotenv_equals_word(unit, units[i].name, p - unit)) {
+      i++;
+    }
+
+    if (i == count ||
+        dotenv_scale(whole, fraction, units[i].ns, INT64_MAX - total,
+                     &scaled) == -1)
+      return -1;
+
+    total += scaled;
+  }
+
+  *bits = (uint64_t)(negative ? -(int64_t)total : (int64_t)total);
+  return 0;
+}
+
+/**
+ * @brief Parses a size such as `512`, `64K` or `1.5GiB` into bytes.
+ */
+static int dotenv_parse_bytes(const char *value, uint64_t *bits) {
+  static const struct {
+    const char *name;
+    uint64_t bytes;
+  } units[] = {{"", 1ULL},
+               {"b", 1ULL},
+               {"k", 1ULL << 10},
+               {"kib", 1ULL << 10},
+               {"kb", 1000ULL},
+               {"m", 1ULL << 20},
+               {"mib", 1ULL << 20},
+               {"mb", 1000000ULL},
+               {"g", 1ULL << 30},
+               {"gib", 1ULL << 30},
+               {"gb", 1000000000ULL},
+               {"t", 1ULL << 40},
+               {"tib", 1ULL << 40},
+               {"tb", 1000000000000ULL}};
+  const char *p = value;
+  uint64_t whole;
+  double fraction;
+
+  if (dotenv_parse_number(&p, &whole, &fraction) == -1)
+    return -1;
+
+  // Allow a space between the number and its unit
+  while (*p == ' ') {
+    p++;
+  }
+
+  size_t len = strlen(p);
+
+  for (size_t i = 0; i < sizeof(units) / sizeof(units[0]); i++) {
+    if (dotenv_equals_word(p, units[i].name, len))
+      return dotenv_scale(whole, fraction, units[i].bytes, UINT64_MAX, bits);
+  }
+
+  return -1;
+}
+
+/**
+ * @brief Converts a value, caching the first conversion.
+ *
+ * The first reader to convert a value claims the cache and stores the result
+ * (or the failure) with release ordering; later readers of the same type only
+ * load it. Conversions to another type than the cached one are not cached.
+ *
+ * @param var The entry of the variable.
+ * @param type The `DOTENV_TYPE_*` of the conversion.
+ * @param parse The parser for the type.
+ * @param bits Receives the 64-bit representation of the result.
+ * @return 0 on success, -1 if the value cannot be converted.
+ */
+static int dotenv_convert(const env_var *var, uint32_t type,
+                          dotenv_parser parse, uint64_t *bits) {
+  uint32_t state = atomic_load_explicit(&var->cache->state,
+                                        memory_order_acquire);
+
+  if ((state & ~DOTENV_CACHE_FAILED) == type) {
+    if (state & DOTENV_CACHE_FAILED)
+      return -1;
+
+    *bits = atomic_load_explicit(&var->cache->bits, memory_order_relaxed);
+    return 0;
+  }
+
+  const char *value = dotenv_var_value(var);
+
+  if (!value)
+    return -1;
+
+  int result = parse(value, bits);
+  uint32_t expected = DOTENV_CACHE_EMPTY;
+
+  if (atomic_compare_exchange_strong_explicit(
+          &var->cache->state, &expected, DOTENV_CACHE_BUSY,
+          memory_order_relaxed, memory_order_relaxed)) {
+    atomic_store_explicit(&var->cache->bits, result == 0 ? *bits : 0,
+                          memory_order_relaxed);
+    atomic_store_explicit(&var->cache->state,
+                          result == 0 ? type : (type | DOTENV_CACHE_FAILED),
+                          memory_order_release);
+  }
+
+  return result;
+}
+
+/**
+ * @brief Looks up a value and converts it with `dotenv_convert`.
+ *
+ * @param key The key of the variable.
+ * @param type The `DOTENV_TYPE_*` of the conversion.
+ * @param parse The parser for the type.
+ * @param bits Receives the 64-bit representation of the result.
+ * @return 0 on success, -1 if the key is not found or cannot be converted.
+ */
+static int dotenv_get_typed(const char *key, uint32_t type,
+                            dotenv_parser parse, uint64_t *bits) {
+  _Atomic long *pin = dotenv_read_begin();
+  const dotenv_table *table = atomic_load(&ctx.table);
+  size_t len = strlen(key);
+  int pos = dotenv_index_find(table, key, len, dotenv_hash(key, len));
+  int result = pos != -1 ? dotenv_convert(&table->vars[pos], type, parse, bits)
+                         : -1;
+
+  dotenv_read_end(pin);
+  return result;
+}
+
+int dotenv_get_int64(const char *key, int64_t *out) {
+  uint64_t bits;
+
+  if (dotenv_get_typed(key, DOTENV_TYPE_INT64, dotenv_parse_int64, &bits) == -1)
+    return -1;
+
+  *out = (int64_t)bits;
+  return 0;
+}
+
+int dotenv_get_bool(const char *key, int *out) {
+  uint64_t bits;
+
+  if (dotenv_get_typed(key, DOTENV_TYPE_BOOL, dotenv_parse_bool, &bits) == -1)
+    return -1;
+
+  *out = (int)bits;
+  return 0;
+}
+
+int dotenv_get_double(const char *key, double *out) {
+  uint64_t bits;
+
+  if (dotenv_get_typed(key, DOTENV_TYPE_DOUBLE, dotenv_parse_double, &bits) ==
+      -1)
+    return -1;
+
+  memcpy(out, &bits, sizeof(*out));
+  return 0;
+}
+
+int dotenv_get_duration_ns(const char *key, int64_t *out) {
+  uint64_t bits;
+
+  if (dotenv_get_typed(key, DOTENV_TYPE_DURATION, dotenv_parse_duration,
+                       &bits) == -1)
+    return -1;
+
+  *out = (int64_t)bits;
+  return 0;
+}
+
+int dotenv_get_bytes(const char *key, uint64_t *out) {
+  uint64_t bits;
+
+  if (dotenv_get_typed(key, DOTENV_TYPE_BYTES, dotenv_parse_bytes, &bits) == -1)
+    return -1;
+
+  *out = bits;
+  return 0;
+}
+
+/**
+ * @brief Keeps a table that may still be read until `dotenv_reclaim` frees it.
+ *
+ * The caller must hold `ctx.mutex`.
+ *
+ * @param table The table to retire (may be NULL).
+ */
+static void dotenv_retire(dotenv_table *table) {
+  if (table) {
+    table->next_retired = ctx.retired;
+    table->retired_epoch = atomic_load(&ctx.epoch);
+    table->mark = DOTENV_MARK_RETIRED;
+    ctx.retired = table;
+  }
+}
+
+/**
+ * @brief Returns the number of readers counted in an epoch parity.
+ *
+ * @param parity The parity, 0 or 1.
+ * @return The number of readers.
+ */
+static long dotenv_reader_total(unsigned long parity) {
+  long total = atomic_load(&ctx.shared_reader.count[parity]);
+
+  for (dotenv_reader *reader = atomic_load(&ctx.readers); reader;
+       reader = reader->next) {
+    total += atomic_load(&reader->count[parity]);
+  }
+
+  return total;
+}
+
+/**
+ * @brief Marks a retired table as reachable.
+ *
+ * @param table The table (may be NULL or never retired).
+ */
+static void dotenv_reach(const dotenv_table *table) {
+  // Only retired tables are marked; the others may be static and constant
+  if (table && table->mark == DOTENV_MARK_RETIRED) {
+    ((dotenv_table *)table)->mark = DOTENV_MARK_REACHED;
+  }
+}
+
+/**
+ * @brief Marks the tables the unexpanded lazy values of a table resolve in.
+ *
+ * Shadowed entries are skipped, since lookups never return them.
+ *
+ * @param table The table (may be NULL).
+ */
+static void dotenv_reach_scopes(const dotenv_table *table) {
+  for (int i = 0; table && i < table->var_count; i++) {
+    const env_var *var = &table->vars[i];
+    const dotenv_scope *scope = var->cache->scope;
+
+    if (var->value || !scope ||
+        atomic_load_explicit(&var->cache->expanded, memory_order_relaxed) ||
+        dotenv_index_find(table, var->key, var->key_len, var->hash) != i)
+      continue;
+
+    dotenv_reach(scope->table);
+    dotenv_reach(scope->base);
+    dotenv_reach(scope->environment);
+  }
+}
+
+/**
+ * @brief Frees the retired tables nobody can read anymore.
+ *
+ * Readers count themselves under the parity of the epoch they started in.
+ * The epoch moves from `e` to `e + 1` once no reader of epoch `e - 1` is left,
+ * so after two moves every reader that could have loaded a table retired in
+ * `e` is done. Such a table is freed unless a lazy value that is not expanded
+ * yet still resolves in it; those are found by following the scopes of the
+ * lazy values of the published table, of the watcher's snapshot and of every
+ * table kept. The caller must hold `ctx.mutex`.
+ */
+static void dotenv_reclaim(void) {
+  if (!ctx.retired)
+    return;
+
+  for (int step = 0; step < 2; step++) {
+    unsigned long epoch = atomic_load(&ctx.epoch);
+
+    if (dotenv_reader_total((epoch + 1) & 1) != 0)
+      break;
+
+    atomic_store(&ctx.epoch, epoch + 1);
+  }
+
+  unsigned long epoch = atomic_load(&ctx.epoch);
+
+  for (dotenv_table *table = ctx.retired; table; table = table->next_retired) {
+    table->mark = epoch - table->retired_epoch < 2 ? DOTENV_MARK_REACHED
+                                                  : DOTENV_MARK_RETIRED;
+  }
+
+  dotenv_reach(ctx.pinned);
+  dotenv_reach_scopes(atomic_load_explicit(&ctx.table, memory_order_relaxed));
+
+  for (int progress = 1; progress;) {
+    progress = 0;
+
+    for (dotenv_table *table = ctx.retired; table;
+         table = table->next_retired) {
+      if (table->mark == DOTENV_MARK_REACHED) {
+        table->mark = DOTENV_MARK_SCANNED;
+        dotenv_reach_scopes(table);
+        progress = 1;
+      }
+    }
+  }
+
+  dotenv_table **link = &ctx.retired;
+
+  while (*link) {
+    dotenv_table *table = *link;
+
+    if (table->mark == DOTENV_MARK_RETIRED) {
+      *link = table->next_retired;
+      dotenv_table_destroy(table);
+    } else {
+      link = &table->next_retired;
+    }
+  }
+}
+
+/**
+ * @brief Publishes a table and retires the one it replaces.
+ *
+ * Also redirects every interned key to the new table and frees the retired
+ * tables that can no longer be read. The caller must hold `ctx.mutex`.
+ *
+ * @param table The fully built table to publish.
+ */
+static void dotenv_publish(dotenv_table *table) {
+  dotenv_table *previous =
+      atomic_load_explicit(&ctx.table, memory_order_relaxed);
+
+  atomic_store(&ctx.table, table);
+
+  // Redirect interned keys to their values in the new table
+  for (dotenv_handle handle = 0; handle < ctx.slot_count; handle++) {
+    dotenv_slot_refresh(dotenv_slot_at(handle), table);
+  }
+
+  dotenv_retire(previous);
+  dotenv_reclaim();
+}
+
+/**
+ * @brief Merges the entries of a parsed file into the published table.
+ *
+ * The merged table is built without holding the lock against the table that
+ * is current at that point. The lock is then only taken to check that no other
+ * load has published in the meantime, swap the table in and hand the arena
+ * over; if another load won the race, the merge is redone against its table.
+ * Entries interpolated against a given table cannot simply be merged again,
+ * so in that case the caller is told to interpolate them once more.
+ *
+ * @param staging The parsed entries (owned by the caller).
+ * @param arena The arena holding their keys and values, emptied on success.
+ * @param replace Whether the entries override published ones with the same
+ * key.
+ * @param drop Keys to remove from the published table (may be NULL).
+ * @param scope Scope of the lazy entries, filled in on success (may be NULL).
+ * Its `base` defaults to the table being replaced.
+ * @param resolved Points to the table the entries were interpolated against
+ * (NULL if nothing was published), which the caller keeps readable; NULL if
+ * they do not depend on the published table.
+ * @return 0 on success, 1 if `*resolved` is no longer the published table,
+ * -1 if the variables are frozen or memory allocation fails.
+ */
+static int dotenv_commit(const dotenv_table *staging, dotenv_arena *arena,
+                         int replace, const dotenv_table *drop,
+                         dotenv_scope *scope,
+                         const dotenv_table *const *resolved) {
+  for (;;) {
+    // Pinned until the check below, so its address cannot be reused
+    _Atomic long *pin = dotenv_read_begin();
+    dotenv_table *current = atomic_load(&ctx.table);
+
+    if (resolved && current != *resolved) {
+      dotenv_read_end(pin);
+      return 1;
+    }
+
+    dotenv_table *merged = dotenv_table_merge(current, staging, replace, drop);
+
+    if (!merged) {
+      dotenv_read_end(pin);
+      return -1;
+    }
+
+    pthread_mutex_lock(&ctx.mutex);
+
+    if (atomic_load_explicit(&ctx.frozen, memory_order_relaxed)) {
+      fprintf(stderr, "Variables are frozen, call dotenv_thaw to load more.\n");
+      pthread_mutex_unlock(&ctx.mutex);
+      dotenv_read_end(pin);
+      dotenv_table_destroy(merged);
+      return -1;
+    }
+
+    if (atomic_load_explicit(&ctx.table, memory_order_relaxed) == current) {
+      if (scope) {
+        scope->table = merged;
+        scope->base = scope->base ? scope->base : current;
+      }
+
+      // The new keys and values become owned by the context
+      dotenv_arena_splice(&ctx.arena, arena);
+      dotenv_publish(merged);
+      pthread_mutex_unlock(&ctx.mutex);
+      dotenv_read_end(pin);
+      return 0;
+    }
+
+    pthread_mutex_unlock(&ctx.mutex);
+    dotenv_read_end(pin);
+    dotenv_table_destroy(merged);
+  }
+}
+
+static dotenv_cache *dotenv_cache_create(dotenv_arena *arena) {
+  dotenv_cache *cache = (dotenv_cache *)dotenv_arena_alloc(
+      arena, sizeof(dotenv_cache), _Alignof(dotenv_cache));
+
+  if (!cache)
+    return NULL;
+
+  atomic_init(&cache->state, DOTENV_CACHE_EMPTY);
+  atomic_init(&cache->bits, 0);
+  atomic_init(&cache->expanded, NULL);
+  cache->expanded_len = 0;
+  cache->scope = NULL;
+  cache->visiting = 0;
+
+  return cache;
+}
+
+/**
+ * @brief Fills an entry with a copy of a parsed key and raw value.
+ *
+ * @param var The entry to fill.
+ * @param key The key.
+ * @param value The raw value.
+ * @param arena The arena receiving the copies.
+ * @return 0 on success, -1 if memory allocation fails.
+ */
+static int dotenv_entry_init(env_var *var, dotenv_span key, dotenv_span value,
+                             dotenv_arena *arena) {
+  var->key = dotenv_arena_strndup(arena, key);
+  var->raw = dotenv_arena_strndup(arena, value);
+  var->value = NULL;
+  var->key_len = key.len;
+  var->value_len = 0;
+  var->raw_len = value.len;
+  var->cache = dotenv_cache_create(arena);
+
+  if (!var->key || !var->raw || !var->cache) {
+    perror("Failed to allocate memory for key or value.");
+    return -1;
+  }
+
+  var->hash = dotenv_hash(key.ptr, key.len);
+  return 0;
+}
+
+/**
+ * @brief Tokenizes a range of lines into a table.
+ *
+ * Keys and raw values are copied into the arena, so the range may be unmapped
+ * afterwards. Values are left unresolved.
+ *
+ * @param cursor Start of the first line.
+ * @param end One past the last byte of the range.
+ * @param table The table receiving the entries.
+ * @param arena The arena receiving the keys and raw values.
+ * @return 0 on success, -1 if memory allocation fails.
+ */
+static int dotenv_tokenize(const char *cursor, const char *end,
+                           dotenv_table *table, dotenv_arena *arena) {
+  pthread_once(&dotenv_scan_once, dotenv_scan_select);
+
+  while (cursor < end) {
+    dotenv_span key, value;
+
+    if (!dotenv_parse_line(&cursor, end, &key, &value))
+      continue;
+
+    if (table->var_count >= table->capacity) {
+      if (dotenv_resize(table) == -1)
+        return -1;
+    }
+
+    if (dotenv_entry_init(&table->vars[table->var_count], key, value,
+                          arena) == -1)
+      return -1;
+
+    table->var_count++;
+
+    if (dotenv_index_insert(table, table->var_count - 1) == -1)
+      return -1;
+  }
+
+  return 0;
+}
+
+/// Maximum number of threads parsing concurrently.
+#define DOTENV_MAX_THREADS 8
+
+/// Smallest file worth splitting across threads, in bytes.
+#define DOTENV_PARALLEL_MIN_SIZE (1024 * 1024)
+
+/// Task run on every item of a parallel job.
+typedef void (*dotenv_task)(void *item);
+
+/**
+ * @struct dotenv_parallel_job
+ * @brief Items shared by the threads of a parallel job.
+ */
+typedef struct {
+  dotenv_task task;  ///< Task run on each item.
+  char *items;       ///< The items.
+  size_t item_size;  ///< Size of an item in bytes.
+  size_t count;      ///< Number of items.
+  atomic_size_t next; ///< Next item to hand out.
+} dotenv_parallel_job;
+
+/**
+ * @brief Runs the task of a job on items until none are left.
+ *
+ * @param arg The shared `dotenv_parallel_job`.
+ * @return NULL.
+ */
+static void *dotenv_parallel_worker(void *arg) {
+  dotenv_parallel_job *job = arg;
+
+  for (;;) {
+    size_t i = atomic_fetch_add_explicit(&job->next, 1, memory_order_relaxed);
+
+    if (i >= job->count)
+      break;
+
+    job->task(job->items + i * job->item_size);
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Returns how many threads to use for a number of tasks.
+ *
+ * @param tasks The number of independent tasks.
+ * @return A thread count between 1 and `DOTENV_MAX_THREADS`.
+ */
+static size_t dotenv_thread_count(size_t tasks) {
+  size_t threads = DOTENV_MAX_THREADS;
+
+#ifdef _SC_NPROCESSORS_ONLN
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (cpus > 0 && (size_t)cpus < threads) {
+    threads = (size_t)cpus;
+  }
+#endif
+
+  if (tasks < threads) {
+    threads = tasks;
+  }
+
+  return threads > 0 ? threads : 1;
+}
+
+/**
+ * @brief Runs a task on every item of an array on a small pool of threads.
+ *
+ * The calling thread takes part in the work, so every item is processed even
+ * if no extra thread can be started.
+ *
+ * @param task The task to run.
+ * @param items The items.
+ * @param item_size Size of an item in bytes.
+ * @param count Number of items.
+ */
+static void dotenv_run_parallel(dotenv_task task, void *items,
+                                size_t item_size, size_t count) {
+  dotenv_parallel_job job = {task, items, item_size, count, 0};
+  pthread_t threads[DOTENV_MAX_THREADS];
+  size_t started = 0;
+  size_t wanted = dotenv_thread_count(count);
+
+  while (started + 1 < wanted &&
+         pthread_create(&threads[started], NULL, dotenv_parallel_worker,
+                        &job) == 0) {
+    started++;
+  }
+
+  dotenv_parallel_worker(&job);
+
+  for (size_t i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+}
+
+/**
+ * @struct dotenv_chunk
+ * @brief Range of lines of a file tokenized by one thread.
+ */
+typedef struct {
+  const char *begin;   ///< Start of the first line.
+  const char *end;     ///< One past the last byte.
+  dotenv_table *table; ///< Entries of the range.
+  dotenv_arena arena;  ///< Storage for their keys and raw values.
+  int result;          ///< 0 once tokenized, -1 on error.
+} dotenv_chunk;
+
+/**
+ * @brief Tokenizes one chunk into its own table and arena.
+ *
+ * @param item The `dotenv_chunk` to tokenize.
+ */
+static void dotenv_tokenize_chunk(void *item) {
+  dotenv_chunk *chunk = item;
+
+  chunk->table = dotenv_table_create(
+      dotenv_count_lines(chunk->begin, chunk->end - chunk->begin));
+  chunk->result = chunk->table ? dotenv_tokenize(chunk->begin, chunk->end,
+                                                 chunk->table, &chunk->arena)
+                               : -1;
+}
+
+/**
+ * @brief Tokenizes a mapped file on several threads.
+ *
+ * Splits the file into one chunk per thread, moving each split point forward
+ * to the next line start, then concatenates the chunk tables in file order.
+ * Entries, their order and the first-definition-wins index therefore match a
+ * serial pass.
+ *
+ * @param file The mapped file.
+ * @param table The table receiving the entries.
+ * @param arena The arena receiving every chunk's storage.
+ * @return 0 on success, -1 if memory allocation fails.
+ */
+static int dotenv_tokenize_parallel(const dotenv_file *file,
+                                    dotenv_table *table, dotenv_arena *arena) {
+  size_t count = dotenv_thread_count(DOTENV_MAX_THREADS);
+  dotenv_chunk chunks[DOTENV_MAX_THREADS];
+  const char *end = file->data + file->size;
+  const char *begin = file->data;
+  int result = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    const char *split = i + 1 == count
+                            ? end
+                            : file->data + file->size / count * (i + 1);
+
+    if (split < begin) {
+      split = begin;
+    }
+
+    if (split < end) {
+      const char *newline = memchr(split, '\n', end - split);
+      split = newline ? newline + 1 : end;
+    }
+
+    chunks[i] = (dotenv_chunk){begin, split, NULL, {NULL, NULL}, -1};
+    begin = split;
+  }
+
+  dotenv_run_parallel(dotenv_tokenize_chunk, chunks, sizeof(dotenv_chunk),
+                      count);
+
+  for (size_t i = 0; i < count; i++) {
+    const dotenv_table *part = chunks[i].table;
+
+    if (result == 0 && chunks[i].result == 0) {
+      for (int j = 0; j < part->var_count; j++) {
+        table->vars[table->var_count] = part->vars[j];
+        table->var_count++;
+
+        if (dotenv_index_insert(table, table->var_count - 1) == -1) {
+          result = -1;
+          break;
+        }
+      }
+    } else {
+      result = -1;
+    }
+
+    if (part) {
+      dotenv_table_destroy(chunks[i].table);
+    }
+
+    dotenv_arena_splice(arena, &chunks[i].arena);
+  }
+
+  return result;
+}
+
+/**
+ * @struct dotenv_source
+ * @brief A `.env` file parsed into a table, before interpolation.
+ */
+typedef struct {
+  const char *filename;      ///< Path of the file.
+  unsigned flags;            ///< `DOTENV_LOAD_*` options.
+  dotenv_table *table;       ///< Parsed entries with their raw values.
+  dotenv_arena arena;        ///< Storage for the keys and raw values.
+  int result;                ///< 0 once parsed, -1 if parsing failed.
+  dotenv_table *environment; ///< Environment snapshot merged in, or NULL.
+} dotenv_source;
+
+/**
+ * @brief Maps a `.env` file and tokenizes it into a table.
+ *
+ * Keys and raw values are copied into the source's arena, so the file is
+ * unmapped before returning. Values are left unresolved.
+ *
+ * @param source The source to fill; `filename` and `flags` must be set.
+ * @return 0 on success, -1 if the file cannot be read or memory allocation
+ * fails.
+ */
+static int dotenv_parse_source(dotenv_source *source) {
+  dotenv_file file;
+
+  source->table = NULL;
+  source->arena.head = NULL;
+  source->arena.tail = NULL;
+  source->result = -1;
+  source->environment = NULL;
+
+  if (dotenv_map_file(source->filename, &file) == -1) {
+    perror("Failed to open .env file.");
+    return -1;
+  }
+
+  dotenv_table *table =
+      dotenv_table_create(dotenv_count_lines(file.data, file.size));
+
+  if (!table) {
+    dotenv_unmap_file(&file);
+    return -1;
+  }
+
+  int result;
+
+  if ((source->flags & DOTENV_LOAD_PARALLEL) &&
+      file.size >= DOTENV_PARALLEL_MIN_SIZE) {
+    result = dotenv_tokenize_parallel(&file, table, &source->arena);
+  } else {
+    result = dotenv_tokenize(file.data, file.data + file.size, table,
+                             &source->arena);
+  }
+
+  dotenv_unmap_file(&file);
+
+  if (result == -1) {
+    dotenv_table_destroy(table);
+    dotenv_arena_release(&source->arena);
+    return -1;
+  }
+
+  source->table = table;
+  source->result = 0;
+  return 0;
+}
+
+/**
+ * @brief Parses one source of a parallel job.
+ *
+ * @param item The `dotenv_source` to parse.
+ */
+static void dotenv_parse_source_task(void *item) { dotenv_parse_source(item); }
+
+/**
+ * @brief Releases whatever a source still owns.
+ *
+ * @param source The source to release.
+ */
+static void dotenv_source_release(dotenv_source *source) {
+  if (source->table) {
+    dotenv_table_destroy(source->table);
+    source->table = NULL;
+  }
+
+  dotenv_arena_release(&source->arena);
+}
+
+/**
+ * @brief Interpolates a parsed table and merges it into the published one.
+ *
+ * @param table The parsed entries.
+ * @param arena The arena holding their keys and values, emptied on success.
+ * @param replace Whether the entries override published ones with the same
+ * key.
+ * @param drop Keys to remove from the published table (may be NULL).
+ * @param previous Previous definitions seen by self references, or NULL for
+ * the published table.
+ * @param environment Environment snapshot merged into `table`, or NULL.
+ * @param below For each entry, the position of the definition it overrides
+ * in `table`, or -1; NULL if nothing is overridden. Overridden definitions
+ * are placed last and left out of the index; they are resolved for the self
+ * references of the entries overriding them, but not published.
+ * @return 0 on success, -1 on a reference cycle or if memory allocation fails.
+ */
+static int dotenv_resolve_and_commit(dotenv_table *table, dotenv_arena *arena,
+                                     int replace, const dotenv_table *drop,
+                                     const dotenv_table *previous,
+                                     const dotenv_table *environment,
+                                     const int *below) {
+  int count = table->var_count;
+  int visible = count;
+  unsigned char *pending = malloc(count ? count : 1);
+
+  if (!pending) {
+    perror("Failed to allocate memory for interpolation.");
+    return -1;
+  }
+
+  for (int i = 0; i < table->var_count; i++) {
+    pending[i] = !table->vars[i].value;
+  }
+
+  // Overridden definitions come last, and the index does not find them
+  for (; below && visible > 0; visible--) {
+    const env_var *var = &table->vars[visible - 1];
+
+    if (dotenv_index_find(table, var->key, var->key_len, var->hash) ==
+        visible - 1)
+      break;
+  }
+
+  dotenv_resolver resolver = {
+      NULL,    drop,         previous, environment, table, below,
+      replace, {NULL, 0, 0}, arena};
+  int result;
+
+  // Another load may publish meanwhile; the values then depend on a stale
+  // table, so they are interpolated again against the new one
+  do {
+    _Atomic long *pin = dotenv_read_begin();
+
+    resolver.base = atomic_load(&ctx.table);
+    resolver.previous = previous ? previous : resolver.base;
+    result = dotenv_resolve_table(&resolver, NULL);
+
+    if (result == 0) {
+      table->var_count = visible;
+      result = dotenv_commit(table, arena, replace, drop, NULL, &resolver.base);
+      table->var_count = count;
+    }
+
+    dotenv_read_end(pin);
+
+    for (int i = 0; result == 1 && i < table->var_count; i++) {
+      if (pending[i]) {
+        table->vars[i].value = NULL;
+        table->vars[i].value_len = 0;
+      }
+    }
+  } while (result == 1);
+
+  free(resolver.scratch.data);
+  free(pending);
+  return result;
+}
+
+/**
+ * @brief Defers the interpolation of a parsed table and merges it into the
+ * published one.
+ *
+ * Values without placeholders are used as is; the others are left to
+ * `dotenv_var_value` and point at a scope shared by the whole file. Entries
+ * kept from a previous load of the same file keep their scope. The new lazy
+ * entries and what they refer to are checked for reference cycles first, so
+ * a file an eager load would reject is rejected as well.
+ *
+ * @param table The parsed entries.
+ * @param arena The arena holding their keys and values, emptied on success.
+ * @param replace Whether the entries override published ones with the same
+ * key.
+ * @param drop Keys to remove from the published table (may be NULL).
+ * @param previous Previous definitions seen by self references, or NULL for
+ * the published table.
+ * @param environment Environment snapshot merged into `table`, or NULL.
+ * @return 0 on success, -1 on a reference cycle or if memory allocation fails.
+ */
+static int dotenv_defer_and_commit(dotenv_table *table, dotenv_arena *arena,
+                                   int replace, const dotenv_table *drop,
+                                   const dotenv_table *previous,
+                                   const dotenv_table *environment) {
+  dotenv_scope *scope = (dotenv_scope *)dotenv_arena_alloc(
+      arena, sizeof(dotenv_scope), _Alignof(dotenv_scope));
+  unsigned char *roots = calloc(table->var_count ? table->var_count : 1, 1);
+
+  if (!scope || !roots) {
+    perror("Failed to allocate memory for interpolation.");
+    free(roots);
+    return -1;
+  }
+
+  scope->table = NULL;
+  scope->base = previous;
+  scope->environment = environment;
+
+  for (int i = 0; i < table->var_count; i++) {
+    env_var *var = &table->vars[i];
+    const char *start;
+    dotenv_span name;
+
+    if (var->value || var->cache->scope)
+      continue;
+
+    if (dotenv_next_placeholder(var->raw, var->raw + var->raw_len, &start,
+                                &name)) {
+      var->cache->scope = scope;
+      roots[i] = 1;
+    } else {
+      var->value = var->raw;
+      var->value_len = var->raw_len;
+    }
+  }
+
+  dotenv_resolver resolver = {
+      NULL,    drop,         previous, environment, table, NULL,
+      replace, {NULL, 0, 0}, arena};
+  int result;
+
+  // Which entries a placeholder refers to depends on the published table
+  do {
+    _Atomic long *pin = dotenv_read_begin();
+
+    resolver.base = atomic_load(&ctx.table);
+    resolver.previous = previous ? previous : resolver.base;
+    result = dotenv_resolve_table(&resolver, roots);
+
+    if (result == 0) {
+      result =
+          dotenv_commit(table, arena, replace, drop, scope, &resolver.base);
+    }
+
+    dotenv_read_end(pin);
+  } while (result == 1);
+
+  free(roots);
+  return result;
+}
+
+/**
+ * @brief Publishes a parsed source, interpolated as its flags request.
+ *
+ * @param source The parsed source.
+ * @param replace Whether its entries override published ones with the same
+ * key.
+ * @param drop Keys to remove from the published table (may be NULL).
+ * @param previous Previous definitions seen by self references, or NULL for
+ * the published table.
+ * @return 0 on success, -1 on a reference cycle or if memory allocation fails.
+ */
+static int dotenv_apply_source(dotenv_source *source, int replace,
+                               const dotenv_table *drop,
+                               const dotenv_table *previous) {
+  if (source->flags & DOTENV_LOAD_LAZY)
+    return dotenv_defer_and_commit(source->table, &source->arena, replace,
+                                   drop, previous, source->environment);
+
+  return dotenv_resolve_and_commit(source->table, &source->arena, replace,
+                                   drop, previous, source->environment, NULL);
+}
+
+/**
+ * @brief Merges a snapshot of the process environment into a parsed source.
+ *
+ * Environment variables are copied into the source's arena with their values
+ * as is, since they are never interpolated. The snapshot is placed after the
+ * file's entries, or before them with `DOTENV_LOAD_ENVIRON_WINS`, so the
+ * first-wins index gives the requested precedence.
+ *
+ * @param source The parsed source.
+ * @return 0 on success, -1 if memory allocation fails.
+ */
+static int dotenv_merge_environ(dotenv_source *source) {
+  int count = 0;
+
+  while (dotenv_environ && dotenv_environ[count]) {
+    count++;
+  }
+
+  dotenv_table *environment = dotenv_table_create(count);
+
+  if (!environment)
+    return -1;
+
+  for (int i = 0; i < count; i++) {
+    const char *entry = dotenv_environ[i];
+    const char *equals = strchr(entry, '=');
+
+    if (!equals || equals == entry)
+      continue;
+
+    dotenv_span key = {entry, (size_t)(equals - entry)};
+    dotenv_span value = {equals + 1, strlen(equals + 1)};
+
+    // Like getenv, the first definition of a name wins
+    if (dotenv_index_find(environment, key.ptr, key.len,
+                          dotenv_hash(key.ptr, key.len)) != -1)
+      continue;
+
+    env_var *var = &environment->vars[environment->var_count];
+
+    if (dotenv_entry_init(var, key, value, &source->arena) == -1) {
+      dotenv_table_destroy(environment);
+      return -1;
+    }
+
+    var->value = var->raw;
+    var->value_len = var->raw_len;
+    environment->var_count++;
+    dotenv_index_insert(environment, environment->var_count - 1);
+  }
+
+  dotenv_table *merged =
+      (source->flags & DOTENV_LOAD_ENVIRON_WINS)
+          ? dotenv_table_merge(environment, source->table, 0, NULL)
+          : dotenv_table_merge(source->table, environment, 0, NULL);
+
+  if (!merged) {
+    dotenv_table_destroy(environment);
+    return -1;
+  }
+
+  dotenv_table_destroy(source->table);
+  source->table = merged;
+  source->environment = environment;
+
+  return 0;
+}
+
+int dotenv_load(const char *filename) { return dotenv_load_ex(filename, 0); }
+
+int dotenv_load_ex(const char *filename, unsigned flags) {
+  dotenv_source source = {filename, flags, NULL, {NULL, NULL}, -1, NULL};
+
+  if (dotenv_parse_source(&source) == -1)
+    return -1;
+
+  int result = 0;
+
+  if (flags & (DOTENV_LOAD_ENVIRON | DOTENV_LOAD_ENVIRON_WINS)) {
+    result = dotenv_merge_environ(&source);
+  }
+
+  if (result == 0) {
+    result = dotenv_apply_source(&source, 0, NULL, NULL);
+  }
+
+  if (source.environment && result == 0) {
+    // Lazy values may still read the snapshot
+    pthread_mutex_lock(&ctx.mutex);
+    dotenv_retire(source.environment);
+    dotenv_reclaim();
+    pthread_mutex_unlock(&ctx.mutex);
+  } else if (source.environment) {
+    dotenv_table_destroy(source.environment);
+  }
+
+  dotenv_source_release(&source);
+  return result;
+}
+
+int dotenv_load_layers(const char **files, size_t count) {
+  dotenv_source *sources = calloc(count ? count : 1, sizeof(dotenv_source));
+  dotenv_arena arena = {NULL, NULL};
+  dotenv_table *merged = NULL;
+  int *below = NULL;
+  int total = 0;
+  int shadowed = 0;
+  int result = -1;
+
+  if (!sources) {
+    perror("Failed to allocate memory for layered files.");
+    return -1;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    sources[i].filename = files[i];
+  }
+
+  dotenv_run_parallel(dotenv_parse_source_task, sources, sizeof(dotenv_source),
+                      count);
+
+  for (size_t i = 0; i < count; i++) {
+    if (sources[i].result == -1)
+      goto done;
+
+    total += sources[i].table->var_count;
+  }
+
+  merged = dotenv_table_create(total);
+  below = malloc(sizeof(int) * (total ? total : 1));
+
+  if (!merged || !below) {
+    perror("Failed to allocate memory for layered files.");
+    goto done;
+  }
+
+  // Within a file the first definition wins, as with dotenv_load. A later
+  // file's definition takes the place of an earlier one, which moves to the
+  // end of the table so self references can still find it
+  for (size_t i = 0; i < count; i++) {
+    const dotenv_table *layer = sources[i].table;
+
+    for (int j = 0; j < layer->var_count; j++) {
+      const env_var *var = &layer->vars[j];
+      size_t len = var->key_len;
+
+      if (dotenv_index_find(layer, var->key, len, var->hash) != j)
+        continue;
+
+      int pos = dotenv_index_find(merged, var->key, len, var->hash);
+
+      if (pos == -1) {
+        pos = merged->var_count++;
+        merged->vars[pos] = *var;
+        below[pos] = -1;
+        dotenv_index_insert(merged, pos);
+        continue;
+      }
+
+      int moved = total - ++shadowed;
+
+      merged->vars[moved] = merged->vars[pos];
+      below[moved] = below[pos];
+      merged->vars[pos] = *var;
+      below[pos] = moved;
+    }
+
+    dotenv_arena_splice(&arena, &sources[i].arena);
+  }
+
+  // Close the gap between the winning and the overridden definitions
+  int gap = total - merged->var_count - shadowed;
+
+  memmove(merged->vars + merged->var_count, merged->vars + total - shadowed,
+          sizeof(env_var) * shadowed);
+  memmove(below + merged->var_count, below + total - shadowed,
+          sizeof(int) * shadowed);
+  merged->var_count += shadowed;
+
+  for (int i = 0; i < merged->var_count; i++) {
+    if (below[i] != -1) {
+      below[i] -= gap;
+    }
+  }
+
+  result = dotenv_resolve_and_commit(merged, &arena, 1, NULL, NULL, NULL,
+                                     shadowed ? below : NULL);
+
+done:
+  if (merged) {
+    dotenv_table_destroy(merged);
+  }
+
+  free(below);
+
+  for (size_t i = 0; i < count; i++) {
+    dotenv_source_release(&sources[i]);
+  }
+
+  dotenv_arena_release(&arena);
+  free(sources);
+  return result;
+}
+
+/// Magic bytes opening a compiled image.
+#define DOTENV_IMAGE_MAGIC "CENVIMG"
+
+/// Version of the compiled image layout.
+#define DOTENV_IMAGE_VERSION 3
+
+/// Written as is, reads differently on a machine with another byte order.
+#define DOTENV_IMAGE_BYTE_ORDER 0x01020304u
+
+/**
+ * @struct dotenv_image_header
+ * @brief Header of a compiled image.
+ *
+ * The header is followed by `count` entries, `index_capacity` 32-bit index
+ * slots and `strings_size` bytes of NUL-terminated keys and values. The slots
+ * are laid out like the index of a table holding the entries in order, so a
+ * table can adopt them. Every field is in the byte order of the machine that
+ * compiled the image.
+ */
+typedef struct {
+  char magic[8];           ///< `DOTENV_IMAGE_MAGIC`.
+  uint32_t version;        ///< `DOTENV_IMAGE_VERSION`.
+  uint32_t byte_order;     ///< `DOTENV_IMAGE_BYTE_ORDER`.
+  uint32_t count;          ///< Number of entries.
+  uint32_t index_capacity; ///< Number of index slots (a power of two).
+  uint64_t strings_size;   ///< Size of the keys and values in bytes.
+  uint64_t checksum;       ///< `dotenv_image_checksum` of the rest.
+} dotenv_image_header;
+
+/**
+ * @struct dotenv_image_entry
+ * @brief Entry of a compiled image.
+ */
+typedef struct {
+  uint64_t hash;         ///< Hash of the key.
+  uint32_t key_offset;   ///< Offset of the key in the strings.
+  uint32_t key_len;      ///< Length of the key.
+  uint32_t value_offset; ///< Offset of the resolved value in the strings.
+  uint32_t value_len;    ///< Length of the value.
+} dotenv_image_entry;
+
+/**
+ * @struct dotenv_image
+ * @brief Compiled image mapped by `dotenv_load_compiled`.
+ */
+typedef struct dotenv_image {
+  dotenv_file file;          ///< The mapped image.
+  dotenv_cache *caches;      ///< Conversion caches of its entries.
+  struct dotenv_image *next; ///< Previously loaded image.
+} dotenv_image;
+
+/**
+ * @brief Computes the checksum of the body of an image.
+ *
+ * FNV-1a over single bytes waits for one multiply per byte. This runs four
+ * FNV-style lanes over 8-byte words instead, which keeps several multiplies
+ * in flight, then folds the lanes and the remaining bytes together.
+ *
+ * @param data The bytes following the header.
+ * @param size Their number.
+ * @return The checksum.
+ */
+static uint64_t dotenv_image_checksum(const char *data, size_t size) {
+  uint64_t lanes[4] = {14695981039346656037ULL, 1, 2, 3};
+  size_t i = 0;
+
+  for (; i + sizeof(lanes) <= size; i += sizeof(lanes)) {
+    for (int j = 0; j < 4; j++) {
+      uint64_t word;
+
+      memcpy(&word, data + i + j * sizeof(word), sizeof(word));
+      lanes[j] = (lanes[j] ^ word) * 1099511628211ULL;
+      lanes[j] ^= lanes[j] >> 29;
+    }
+  }
+
+  uint64_t checksum = dotenv_hash(data + i, size - i);
+
+  for (int j = 0; j < 4; j++) {
+    checksum = dotenv_phash_mix(checksum ^ lanes[j]);
+  }
+
+  return checksum;
+}
+
+/**
+ * @brief Parses and resolves a `.env` file on its own.
+ *
+ * Placeholders only see the file itself, not the variables loaded so far, so
+ * the result can be stored and loaded elsewhere.
+ *
+ * @param source The source to fill; `filename` and `flags` must be set. Must be
+ * released with `dotenv_source_release`, even on failure.
+ * @return 0 on success, -1 if the file cannot be read, holds a reference cycle
+ * or memory allocation fails.
+ */
+static int dotenv_parse_standalone(dotenv_source *source) {
+  if (dotenv_parse_source(source) == -1)
+    return -1;
+
+  dotenv_resolver resolver = {
+      NULL, NULL, NULL, NULL, source->table, NULL, 0, {NULL, 0, 0},
+      &source->arena};
+  int result = dotenv_resolve_table(&resolver, NULL);
+
+  free(resolver.scratch.data);
+  return result;
+}
+
+/**
+ * @brief Writes a file and moves it over its destination in one step.
+ *
+ * The contents go to a temporary file in the same directory, which is then
+ * renamed over `dst`. A process that has the previous file mapped keeps
+ * reading the old contents instead of faulting on a truncated file, and a
+ * failed write leaves the previous file in place. On Windows, where rename
+ * cannot replace a file, the destination is removed first.
+ *
+ * @param dst Path of the file to replace.
+ * @param data The new contents.
+ * @param size The size of the contents in bytes.
+ * @return 0 on success, -1 if the file cannot be written.
+ */
+static int dotenv_replace_file(const char *dst, const char *data,
+                               size_t size) {
+  static _Atomic unsigned next_temp;
+  size_t temp_size = strlen(dst) + 48;
+  char *temp = malloc(temp_size);
+
+  if (!temp) {
+    perror("Failed to create compiled image.");
+    return -1;
+  }
+
+#ifdef _WIN32
+  long owner = 0;
+#else
+  long owner = (long)getpid();
+#endif
+
+  // Unique per process and call; "x" fails rather than reuse a stale file
+  snprintf(temp, temp_size, "%s.%ld.%u.tmp", dst, owner,
+           atomic_fetch_add(&next_temp, 1));
+
+  FILE *file = fopen(temp, "wbx");
+
+  if (!file) {
+    perror("Failed to create compiled image.");
+    free(temp);
+    return -1;
+  }
+
+  int result = fwrite(data, 1, size, file) == size ? 0 : -1;
+
+  if (fclose(file) != 0 || result == -1) {
+    perror("Failed to write compiled image.");
+    result = -1;
+  }
+
+#ifdef _WIN32
+  // rename does not replace an existing file on Windows, which also refuses
+  // to remove a file that is mapped, so a mapped image is never truncated
+  if (result == 0) {
+    remove(dst);
+  }
+#endif
+
+  if (result == 0 && rename(temp, dst) != 0) {
+    perror("Failed to replace compiled image.");
+    result = -1;
+  }
+
+  if (result == -1) {
+    remove(temp);
+  }
+
+  free(temp);
+  return result;
+}
+
+int dotenv_compile(const char *src, const char *dst) {
+  dotenv_source source = {src, 0, NULL, {NULL, NULL}, -1, NULL};
+  char *image = NULL;
+  int result = -1;
+
+  if (dotenv_parse_standalone(&source) == -1)
+    goto done;
+
+  const dotenv_table *table = source.table;
+
+  uint32_t count = 0;
+  uint64_t strings_size = 0;
+
+  // Only the definitions the index finds are kept
+  for (int i = 0; i < table->var_count; i++) {
+    const env_var *var = &table->vars[i];
+
+    if (dotenv_index_find(table, var->key, var->key_len, var->hash) != i)
+      continue;
+
+    count++;
+    strings_size += var->key_len + var->value_len + 2;
+  }
+
+  if (strings_size > UINT32_MAX) {
+    fprintf(stderr, "Too much data to compile %s.\n", src);
+    goto done;
+  }
+
+  size_t entries_size = sizeof(dotenv_image_entry) * count;
+  uint32_t index_capacity = (uint32_t)dotenv_index_capacity_for((int)count);
+  size_t index_size = sizeof(int32_t) * index_capacity;
+  size_t size = sizeof(dotenv_image_header) + entries_size + index_size +
+                (size_t)strings_size;
+
+  image = calloc(1, size);
+
+  if (!image) {
+    perror("Failed to allocate memory for the compiled image.");
+    goto done;
+  }
+
+  dotenv_image_header *header = (dotenv_image_header *)image;
+  dotenv_image_entry *entries =
+      (dotenv_image_entry *)(image + sizeof(dotenv_image_header));
+  int32_t *index = (int32_t *)((char *)entries + entries_size);
+  char *strings = (char *)index + index_size;
+  size_t mask = (size_t)index_capacity - 1;
+  uint32_t n = 0;
+  uint32_t offset = 0;
+
+  memset(index, -1, index_size);
+
+  for (int i = 0; i < table->var_count; i++) {
+    const env_var *var = &table->vars[i];
+    size_t key_len = var->key_len;
+    size_t value_len = var->value_len;
+
+    if (dotenv_index_find(table, var->key, key_len, var->hash) != i)
+      continue;
+
+    entries[n] = (dotenv_image_entry){var->hash, offset, (uint32_t)key_len,
+                                      offset + (uint32_t)key_len + 1,
+                                      (uint32_t)value_len};
+
+    memcpy(strings + offset, var->key, key_len + 1);
+    memcpy(strings + offset + key_len + 1, var->value, value_len + 1);
+    offset += (uint32_t)(key_len + value_len + 2);
+
+    // Probed like dotenv_index_place, so loading can adopt the slots
+    size_t slot = (size_t)var->hash & mask;
+
+    while (index[slot] != -1) {
+      slot = (slot + 1) & mask;
+    }
+
+    index[slot] = (int32_t)n++;
+  }
+
+  memcpy(header->magic, DOTENV_IMAGE_MAGIC, sizeof(header->magic));
+  header->version = DOTENV_IMAGE_VERSION;
+  header->byte_order = DOTENV_IMAGE_BYTE_ORDER;
+  header->count = count;
+  header->index_capacity = index_capacity;
+  header->strings_size = strings_size;
+  header->checksum = dotenv_image_checksum(image + sizeof(dotenv_image_header),
+                                           size - sizeof(dotenv_image_header));
+
+  result = dotenv_replace_file(dst, image, size);
+
+done:
+  free(image);
+  dotenv_source_release(&source);
+  return result;
+}
+
+/**
+ * @brief Checks the header and checksum of a mapped image.
+ *
+ * @param file The mapped image.
+ * @param filename Its path, for error messages.
+ * @return The header, or NULL if the image is invalid.
+ */
+static const dotenv_image_header *dotenv_image_check(const dotenv_file *file,
+                                                     const char *filename) {
+  const dotenv_image_header *header = (const dotenv_image_header *)file->data;
+
+  if (file->size < sizeof(dotenv_image_header) ||
+      memcmp(header->magic, DOTENV_IMAGE_MAGIC, sizeof(header->magic)) != 0) {
+    fprintf(stderr, "%s is not a compiled .env image.\n", filename);
+    return NULL;
+  }
+
+  if (header->byte_order != DOTENV_IMAGE_BYTE_ORDER) {
+    fprintf(stderr, "%s was compiled for another byte order.\n", filename);
+    return NULL;
+  }
+
+  if (header->version != DOTENV_IMAGE_VERSION) {
+    fprintf(stderr, "%s has unsupported image version %u.\n", filename,
+            (unsigned)header->version);
+    return NULL;
+  }
+
+  uint64_t size = sizeof(dotenv_image_header) +
+                  sizeof(dotenv_image_entry) * (uint64_t)header->count +
+                  sizeof(int32_t) * (uint64_t)header->index_capacity +
+                  header->strings_size;
+
+  if (size != file->size || header->count > INT32_MAX / 2 ||
+      header->index_capacity !=
+          (uint32_t)dotenv_index_capacity_for((int)header->count)) {
+    fprintf(stderr, "%s is truncated or corrupt.\n", filename);
+    return NULL;
+  }
+
+  if (dotenv_image_checksum(file->data + sizeof(dotenv_image_header),
+                            file->size - sizeof(dotenv_image_header)) !=
+      header->checksum) {
+    fprintf(stderr, "%s failed checksum validation.\n", filename);
+    return NULL;
+  }
+
+  return header;
+}
+
+/**
+ * @brief Checks that a string of an image lies within its strings.
+ *
+ * @param strings_size The size of the strings.
+ * @param strings The strings.
+ * @param offset The offset of the string.
+ * @param len The length of the string.
+ * @return 1 if the string is in bounds and NUL-terminated, 0 otherwise.
+ */
+static int dotenv_image_string_valid(uint64_t strings_size,
+                                     const char *strings, uint32_t offset,
+                                     uint32_t len) {
+  return (uint64_t)offset + len < strings_size && strings[offset + len] == '\0';
+}
+
+int dotenv_load_compiled(const char *filename) {
+  dotenv_image *image = malloc(sizeof(dotenv_image));
+  dotenv_table *table = NULL;
+  dotenv_arena arena = {NULL, NULL};
+  int adopted = 0;
+
+  if (!image) {
+    perror("Failed to allocate memory for the compiled image.");
+    return -1;
+  }
+
+  image->caches = NULL;
+
+  if (dotenv_map_file(filename, &image->file) == -1) {
+    perror("Failed to open compiled image.");
+    free(image);
+    return -1;
+  }
+
+  const dotenv_image_header *header =
+      dotenv_image_check(&image->file, filename);
+
+  if (!header)
+    goto fail;
+
+  uint32_t count = header->count;
+  const dotenv_image_entry *entries =
+      (const dotenv_image_entry *)(image->file.data +
+                                   sizeof(dotenv_image_header));
+  const int32_t *index = (const int32_t *)(entries + count);
+  const char *strings = (const char *)(index + header->index_capacity);
+
+  // Every field of an empty cache is zero, so the pages of untouched caches
+  // are never written
+  image->caches = calloc(count ? count : 1, sizeof(dotenv_cache));
+  table = dotenv_table_create((int)count);
+
+  if (!table || !image->caches) {
+    perror("Failed to allocate memory for the compiled image.");
+    goto fail;
+  }
+
+  // The slots are only trusted once every position is in range and at least
+  // one slot is free, so lookups stay within the entries and terminate
+  uint32_t used = 0;
+
+  for (uint32_t i = 0; i < header->index_capacity; i++) {
+    if (index[i] < -1 || index[i] >= (int32_t)count) {
+      fprintf(stderr, "%s is truncated or corrupt.\n", filename);
+      goto fail;
+    }
+
+    used += index[i] != -1;
+    table->index[i] = index[i];
+  }
+
+  if (used != count) {
+    fprintf(stderr, "%s is truncated or corrupt.\n", filename);
+    goto fail;
+  }
+
+  // Keys and values are used in place
+  for (uint32_t i = 0; i < count; i++) {
+    const dotenv_image_entry *entry = &entries[i];
+    env_var *var = &table->vars[i];
+
+    if (!dotenv_image_string_valid(header->strings_size, strings,
+                                   entry->key_offset, entry->key_len) ||
+        !dotenv_image_string_valid(header->strings_size, strings,
+                                   entry->value_offset, entry->value_len)) {
+      fprintf(stderr, "%s is truncated or corrupt.\n", filename);
+      goto fail;
+    }
+
+    var->key = (char *)strings + entry->key_offset;
+    var->value = (char *)strings + entry->value_offset;
+    var->raw = var->value;
+    var->key_len = entry->key_len;
+    var->value_len = entry->value_len;
+    var->raw_len = entry->value_len;
+    var->hash = entry->hash;
+    var->cache = &image->caches[i];
+  }
+
+  table->var_count = (int)count;
+
+  // With nothing loaded yet there is nothing to merge with, so the table is
+  // published as is
+  pthread_mutex_lock(&ctx.mutex);
+
+  if (!atomic_load_explicit(&ctx.frozen, memory_order_relaxed) &&
+      !atomic_load_explicit(&ctx.table, memory_order_relaxed)) {
+    dotenv_publish(table);
+    adopted = 1;
+  }
+
+  pthread_mutex_unlock(&ctx.mutex);
+
+  if (!adopted) {
+    if (dotenv_commit(table, &arena, 0, NULL, NULL, NULL) == -1)
+      goto fail;
+
+    dotenv_table_destroy(table);
+  }
+
+  // The published values point into the mapping, which is kept until freed
+  pthread_mutex_lock(&ctx.mutex);
+  image->next = ctx.images;
+  ctx.images = image;
+  pthread_mutex_unlock(&ctx.mutex);
+
+  return 0;
+
+fail:
+  if (table) {
+    dotenv_table_destroy(table);
+  }
+
+  dotenv_unmap_file(&image->file);
+  free(image->caches);
+  free(image);
+  return -1;
+}
+
+/// Average number of keys per perfect hash bucket.
+#define DOTENV_PHASH_BUCKET_SIZE 4
+
+/// Number of seeds tried for a bucket before giving up.
+#define DOTENV_PHASH_MAX_SEEDS (1u << 24)
+
+/**
+ * @brief Releases the arrays of a perfect hash.
+ *
+ * @param phash The perfect hash to release.
+ */
+static void dotenv_phash_release(dotenv_phash *phash) {
+  free(phash->seeds);
+  free(phash->remap);
+  phash->seeds = NULL;
+  phash->remap = NULL;
+}
+
+/**
+ * @brief Builds a minimal perfect hash over a set of key hashes.
+ *
+ * Uses hash-and-displace: keys are spread into buckets by
+ * `dotenv_phash_bucket`, and buckets are placed from the largest to the
+ * smallest by searching, for each, the first seed for which
+ * `dotenv_phash_slot` sends all its keys to distinct free slots. A few spare
+ * slots keep that search short; the keys landing in them are then remapped to
+ * the slots left free below `count`, so the result is minimal.
+ *
+ * @param hashes The hashes of the keys, as returned by `dotenv_hash`.
+ * @param count The number of keys.
+ * @param phash The perfect hash to fill, released with `dotenv_phash_release`.
+ * @param slots Receives the final slot of each key (`count` entries).
+ * @return 0 on success, -1 if two keys have the same hash or memory allocation
+ * fails.
+ */
+static int dotenv_phash_build(const uint64_t *hashes, uint32_t count,
+                              dotenv_phash *phash, uint32_t *slots) {
+  uint32_t buckets = count / DOTENV_PHASH_BUCKET_SIZE + 1;
+  uint32_t slot_count = count + count / 64 + 1;
+  uint32_t *start = calloc((size_t)buckets + 1, sizeof(uint32_t));
+  uint32_t *members = malloc(sizeof(uint32_t) * (count ? count : 1));
+  uint32_t *order = malloc(sizeof(uint32_t) * buckets);
+  uint32_t *by_size = NULL;
+  unsigned char *taken = calloc(slot_count, 1);
+  int result = -1;
+
+  phash->count = count;
+  phash->slot_count = slot_count;
+  phash->bucket_count = buckets;
+  phash->seeds = calloc(buckets, sizeof(uint32_t));
+  phash->remap = calloc(slot_count - count, sizeof(uint32_t));
+
+  if (!start || !members || !order || !taken || !phash->seeds ||
+      !phash->remap) {
+    perror("Failed to allocate memory for the perfect hash.");
+    goto done;
+  }
+
+  // Group the keys by bucket
+  for (uint32_t i = 0; i < count; i++) {
+    start[dotenv_phash_bucket(hashes[i], buckets) + 1]++;
+  }
+
+  uint32_t largest = 0;
+
+  for (uint32_t b = 0; b < buckets; b++) {
+    largest = start[b + 1] > largest ? start[b + 1] : largest;
+    start[b + 1] += start[b];
+  }
+
+  // `order` holds the write position of each bucket for now
+  memcpy(order, start, sizeof(uint32_t) * buckets);
+
+  for (uint32_t i = 0; i < count; i++) {
+    members[order[dotenv_phash_bucket(hashes[i], buckets)]++] = i;
+  }
+
+  by_size = calloc((size_t)largest + 2, sizeof(uint32_t));
+
+  if (!by_size) {
+    perror("Failed to allocate memory for the perfect hash.");
+    goto done;
+  }
+
+  // Order the buckets from the largest to the smallest
+  for (uint32_t b = 0; b < buckets; b++) {
+    by_size[largest - (start[b + 1] - start[b]) + 1]++;
+  }
+
+  for (uint32_t s = 0; s <= largest; s++) {
+    by_size[s + 1] += by_size[s];
+  }
+
+  for (uint32_t b = 0; b < buckets; b++) {
+    order[by_size[largest - (start[b + 1] - start[b])]++] = b;
+  }
+
+  for (uint32_t o = 0; o < buckets; o++) {
+    uint32_t b = order[o];
+    uint32_t first = start[b];
+    uint32_t size = start[b + 1] - first;
+    uint32_t seed = 0;
+
+    for (uint32_t i = first; i < first + size; i++) {
+      for (uint32_t j = first; j < i; j++) {
+        if (hashes[members[i]] == hashes[members[j]]) {
+          fprintf(stderr, "Two keys have the same hash.\n");
+          goto done;
+        }
+      }
+    }
+
+    for (; size > 0; seed++) {
+      if (seed == DOTENV_PHASH_MAX_SEEDS) {
+        fprintf(stderr, "Failed to build the perfect hash.\n");
+        goto done;
+      }
+
+      uint32_t placed = 0;
+
+      while (placed < size) {
+        uint32_t key = members[first + placed];
+        uint32_t slot = dotenv_phash_slot(hashes[key], seed, slot_count);
+
+        if (taken[slot])
+          break;
+
+        taken[slot] = 1;
+        slots[key] = slot;
+        placed++;
+      }
+
+      if (placed == size)
+        break;
+
+      // Free the slots of this attempt before trying the next seed
+      for (uint32_t i = 0; i < placed; i++) {
+        taken[slots[members[first + i]]] = 0;
+      }
+    }
+
+    phash->seeds[b] = seed;
+  }
+
+  // Each spare slot in use takes over a free slot below `count`
+  for (uint32_t slot = count, free_slot = 0; slot < slot_count; slot++) {
+    if (!taken[slot])
+      continue;
+
+    while (taken[free_slot]) {
+      free_slot++;
+    }
+
+    taken[free_slot] = 1;
+    phash->remap[slot - count] = free_slot;
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    if (slots[i] >= count) {
+      slots[i] = phash->remap[slots[i] - count];
+    }
+  }
+
+  result = 0;
+
+done:
+  if (result == -1) {
+    dotenv_phash_release(phash);
+  }
+
+  free(start);
+  free(members);
+  free(order);
+  free(by_size);
+  free(taken);
+  return result;
+}
+
+/**
+ * @brief Writes a string as a C string literal.
+ *
+ * @param file The file to write to.
+ * @param str The string.
+ */
+static void dotenv_embed_string(FILE *file, const char *str) {
+  fputc('"', file);
+
+  for (const unsigned char *p = (const unsigned char *)str; *p; p++) {
+    if (*p == '"' || *p == '\\' || *p == '?') {
+      fprintf(file, "\\%c", *p);
+    } else if (*p < 0x20 || *p >= 0x7F) {
+      // Three octal digits, so a following digit is not taken in
+      fprintf(file, "\\%03o", *p);
+    } else {
+      fputc(*p, file);
+    }
+  }
+
+  fputc('"', file);
+}
+
+int dotenv_embed(const char *src, const char *dst) {
+  dotenv_source source = {src, 0, NULL, {NULL, NULL}, -1, NULL};
+  uint64_t *hashes = NULL;
+  uint32_t *slots = NULL;
+  const env_var **entries = NULL;
+  dotenv_phash phash = {0, 0, 0, NULL, NULL};
+  int result = -1;
+
+  if (dotenv_parse_standalone(&source) == -1)
+    goto done;
+
+  const dotenv_table *table = source.table;
+  size_t capacity = table->var_count > 0 ? (size_t)table->var_count : 1;
+  uint32_t count = 0;
+
+  hashes = malloc(sizeof(uint64_t) * capacity);
+  slots = malloc(sizeof(uint32_t) * capacity);
+  entries = malloc(sizeof(env_var *) * capacity);
+
+  if (!hashes || !slots || !entries) {
+    perror("Failed to allocate memory for the embedded table.");
+    goto done;
+  }
+
+  // Only the definitions the index finds are kept
+  for (int i = 0; i < table->var_count; i++) {
+    const env_var *var = &table->vars[i];
+
+    if (dotenv_index_find(table, var->key, var->key_len, var->hash) == i) {
+      hashes[count++] = var->hash;
+    }
+  }
+
+  if (dotenv_phash_build(hashes, count, &phash, slots) == -1)
+    goto done;
+
+  for (int i = 0, n = 0; i < table->var_count; i++) {
+    const env_var *var = &table->vars[i];
+
+    if (dotenv_index_find(table, var->key, var->key_len, var->hash) == i) {
+      entries[slots[n++]] = var;
+    }
+  }
+
+  FILE *file = fopen(dst, "w");
+
+  if (!file) {
+    perror("Failed to create embedded header.");
+    goto done;
+  }
+
+  fprintf(file,
+          "/* Generated by cenv_embed from %s. Do not edit. */\n"
+          "#ifndef CENV_EMBEDDED_H\n"
+          "#define CENV_EMBEDDED_H\n\n"
+          "#include <stddef.h>\n"
+          "#include <stdint.h>\n\n"
+          "#define DOTENV_EMBEDDED_COUNT %uu\n"
+          "#define DOTENV_EMBEDDED_SLOTS %uu\n"
+          "#define DOTENV_EMBEDDED_BUCKETS %uu\n\n",
+          src, (unsigned)count, (unsigned)phash.slot_count,
+          (unsigned)phash.bucket_count);
+
+  fprintf(file, "static const char *const dotenv_embedded_keys[] = {\n");
+
+  for (uint32_t i = 0; i < count; i++) {
+    fprintf(file, "    ");
+    dotenv_embed_string(file, entries[i]->key);
+    fprintf(file, ",\n");
+  }
+
+  fprintf(file, "%s};\n\n", count ? "" : "    \"\",\n");
+  fprintf(file, "static const char *const dotenv_embedded_values[] = {\n");
+
+  for (uint32_t i = 0; i < count; i++) {
+    fprintf(file, "    ");
+    dotenv_embed_string(file, entries[i]->value);
+    fprintf(file, ",\n");
+  }
+
+  fprintf(file, "%s};\n\n", count ? "" : "    NULL,\n");
+  fprintf(file, "static const uint64_t dotenv_embedded_hashes[] = {\n");
+
+  for (uint32_t i = 0; i < count; i++) {
+    fprintf(file, "    0x%016llxULL,\n", (unsigned long long)entries[i]->hash);
+  }
+
+  fprintf(file, "%s};\n\n", count ? "" : "    0,\n");
+  fprintf(file, "static const uint32_t dotenv_embedded_seeds[] = {\n");
+
+  for (uint32_t b = 0; b < phash.bucket_count; b++) {
+    fprintf(file, "    %uu,\n", (unsigned)phash.seeds[b]);
+  }
+
+  fprintf(file, "};\n\n");
+  fprintf(file, "static const uint32_t dotenv_embedded_remap[] = {\n");
+
+  for (uint32_t i = 0; i < phash.slot_count - count; i++) {
+    fprintf(file, "    %uu,\n", (unsigned)phash.remap[i]);
+  }
+
+  fprintf(file, "};\n\n"
+                "#define CENV_EMBEDDED\n"
+                "#include <cenv.h>\n\n"
+                "#endif // CENV_EMBEDDED_H\n");
+
+  result = 0;
+
+  if (ferror(file) || fclose(file) != 0) {
+    perror("Failed to write embedded header.");
+    result = -1;
+  }
+
+done:
+  free(hashes);
+  free(slots);
+  free(entries);
+  dotenv_phash_release(&phash);
+  dotenv_source_release(&source);
+  return result;
+}
+
+int dotenv_freeze(void) {
+  int result = -1;
+
+  pthread_mutex_lock(&ctx.mutex);
+
+  if (atomic_load_explicit(&ctx.frozen, memory_order_relaxed)) {
+    pthread_mutex_unlock(&ctx.mutex);
+    return 0;
+  }
+
+  // Holding the lock keeps the table published until the index is swapped in
+  const dotenv_table *table =
+      atomic_load_explicit(&ctx.table, memory_order_relaxed);
+  int var_count = table ? table->var_count : 0;
+  size_t capacity = var_count > 0 ? (size_t)var_count : 1;
+  dotenv_frozen *frozen = calloc(1, sizeof(dotenv_frozen));
+  uint64_t *hashes = malloc(sizeof(uint64_t) * capacity);
+  uint32_t *slots = malloc(sizeof(uint32_t) * capacity);
+  const env_var **vars = malloc(sizeof(env_var *) * capacity);
+  uint32_t count = 0;
+
+  if (!frozen || !hashes || !slots || !vars) {
+    perror("Failed to allocate memory for the frozen table.");
+    goto done;
+  }
+
+  for (int i = 0; i < var_count; i++) {
+    const env_var *var = &table->vars[i];
+
+    if (dotenv_index_find(table, var->key, var->key_len, var->hash) == i) {
+      hashes[count] = var->hash;
+      vars[count++] = var;
+    }
+  }
+
+  if (dotenv_phash_build(hashes, count, &frozen->phash, slots) == -1)
+    goto done;
+
+  frozen->entries = malloc(sizeof(dotenv_frozen_entry) * capacity);
+
+  if (!frozen->entries) {
+    perror("Failed to allocate memory for the frozen table.");
+    goto done;
+  }
+
+  // Lazy values are expanded now, so lookups never take the lock again
+  for (uint32_t i = 0; i < count; i++) {
+    const char *value = dotenv_var_ready(vars[i]);
+
+    if (!value) {
+      value = dotenv_expand_locked(vars[i]);
+    } else if (value == dotenv_unresolved) {
+      value = NULL;
+    }
+
+    frozen->entries[slots[i]] = (dotenv_frozen_entry){
+        vars[i]->hash, vars[i]->key, value, vars[i]->key_len,
+        value ? dotenv_var_length(vars[i]) : 0};
+  }
+
+  atomic_store_explicit(&ctx.frozen, frozen, memory_order_release);
+  frozen = NULL;
+  result = 0;
+
+done:
+  pthread_mutex_unlock(&ctx.mutex);
+
+  if (frozen) {
+    dotenv_phash_release(&frozen->phash);
+    free(frozen->entries);
+    free(frozen);
+  }
+
+  free(hashes);
+  free(slots);
+  free(vars);
+  return result;
+}
+
+/**
+ * @brief Drops the frozen table, if any.
+ *
+ * Readers may still be probing it, so it is kept until `dotenv_free`. The
+ * caller must hold `ctx.mutex`.
+ */
+static void dotenv_thaw_locked(void) {
+  dotenv_frozen *frozen =
+      atomic_load_explicit(&ctx.frozen, memory_order_relaxed);
+
+  if (frozen) {
+    atomic_store_explicit(&ctx.frozen, NULL, memory_order_release);
+    frozen->next_retired = ctx.thawed;
+    ctx.thawed = frozen;
+  }
+}
+
+void dotenv_thaw(void) {
+  pthread_mutex_lock(&ctx.mutex);
+  dotenv_thaw_locked();
+  pthread_mutex_unlock(&ctx.mutex);
+}
+
+#ifdef __linux__
+/**
+ * @struct dotenv_lines
+ * @brief Lines the entries of a watched file were parsed from.
+ *
+ * Keeps the file contents they were read from, so a line can be compared
+ * byte for byte with a line of the next version.
+ */
+typedef struct {
+  uint64_t *hashes; ///< Hash of the line of each entry.
+  size_t *offsets;  ///< Offset of the line of each entry in `data`.
+  size_t *lengths;  ///< Length of the line of each entry.
+  int *index;       ///< Index from line hashes to entries (-1 if empty).
+  int capacity;     ///< Number of index slots (always a power of two).
+  char *data;       ///< The file contents (NULL if empty).
+} dotenv_lines;
+
+/**
+ * @brief Looks up the entry parsed from a given line.
+ *
+ * Candidates are found by hash, then compared byte for byte, so a hash
+ * collision never reuses the entry of another line.
+ *
+ * @param lines The lines of the previous load.
+ * @param line The line, without its newline.
+ * @param len The length of the line.
+ * @param hash The hash of the line.
+ * @return The position of the entry, or -1 if no entry has this line.
+ */
+static int dotenv_lines_find(const dotenv_lines *lines, const char *line,
+                             size_t len, uint64_t hash) {
+  if (!lines->index)
+    return -1;
+
+  size_t mask = (size_t)lines->capacity - 1;
+
+  for (size_t slot = (size_t)hash & mask;; slot = (slot + 1) & mask) {
+    int pos = lines->index[slot];
+
+    if (pos == -1)
+      return -1;
+
+    if (lines->hashes[pos] == hash && lines->lengths[pos] == len &&
+        memcmp(lines->data + lines->offsets[pos], line, len) == 0)
+      return pos;
+  }
+}
+
+/**
+ * @brief Indexes the line hashes of freshly tokenized entries.
+ *
+ * @param lines The line hashes, one per entry.
+ * @param count The number of entries.
+ * @return 0 on success, -1 if memory allocation fails.
+ */
+static int dotenv_lines_build(dotenv_lines *lines, int count) {
+  lines->capacity = dotenv_index_capacity_for(count);
+  lines->index = malloc(sizeof(int) * lines->capacity);
+
+  if (!lines->index) {
+    perror("Failed to allocate memory for line hashes.");
+    return -1;
+  }
+
+  memset(lines->index, -1, sizeof(int) * lines->capacity);
+
+  size_t mask = (size_t)lines->capacity - 1;
+
+  // Identical lines hold identical entries, so the first one is enough
+  for (int pos = 0; pos < count; pos++) {
+    const char *line = lines->data + lines->offsets[pos];
+    size_t len = lines->lengths[pos];
+
+    if (dotenv_lines_find(lines, line, len, lines->hashes[pos]) != -1)
+      continue;
+
+    size_t slot = (size_t)lines->hashes[pos] & mask;
+
+    while (lines->index[slot] != -1) {
+      slot = (slot + 1) & mask;
+    }
+
+    lines->index[slot] = pos;
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Releases the lines of a load.
+ *
+ * @param lines The lines to release.
+ */
+static void dotenv_lines_release(dotenv_lines *lines) {
+  free(lines->hashes);
+  free(lines->offsets);
+  free(lines->lengths);
+  free(lines->index);
+  free(lines->data);
+
+  lines->hashes = NULL;
+  lines->offsets = NULL;
+  lines->lengths = NULL;
+  lines->index = NULL;
+  lines->capacity = 0;
+  lines->data = NULL;
+}
+
+/**
+ * @brief Tokenizes a file, reusing the entries of lines that did not change.
+ *
+ * Each line is hashed and looked up among the lines of the previous load. A
+ * known line gets a copy of its previous entry, sharing its key, raw value,
+ * resolved value and cache; only the other lines are tokenized. The position
+ * of each line in `file` is recorded, and the caller hands the contents over
+ * to `lines` so the next load can compare against them.
+ *
+ * @param file The file contents.
+ * @param table The table receiving the entries, sized for every line.
+ * @param arena The arena receiving new keys and raw values.
+ * @param old The entries of the previous load (may be NULL).
+ * @param old_lines The lines of the previous load.
+ * @param lines Receives the lines of this load.
+ * @return 0 on success, -1 if memory allocation fails.
+ */
+static int dotenv_tokenize_lines(const dotenv_file *file, dotenv_table *table,
+                                 dotenv_arena *arena, const dotenv_table *old,
+                                 const dotenv_lines *old_lines,
+                                 dotenv_lines *lines) {
+  const char *cursor = file->data;
+  const char *end = file->data + file->size;
+
+  pthread_once(&dotenv_scan_once, dotenv_scan_select);
+
+  lines->hashes = malloc(sizeof(uint64_t) * table->capacity);
+  lines->offsets = malloc(sizeof(size_t) * table->capacity);
+  lines->lengths = malloc(sizeof(size_t) * table->capacity);
+
+  if (!lines->hashes || !lines->offsets || !lines->lengths) {
+    perror("Failed to allocate memory for line hashes.");
+    return -1;
+  }
+
+  while (cursor < end) {
+    const char *newline = memchr(cursor, '\n', end - cursor);
+    const char *line_end = newline ? newline : end;
+    size_t len = (size_t)(line_end - cursor);
+    uint64_t hash = dotenv_hash(cursor, len);
+    int before = dotenv_lines_find(old_lines, cursor, len, hash);
+    env_var *var = &table->vars[table->var_count];
+
+    if (before != -1) {
+      *var = old->vars[before];
+    } else {
+      const char *line = cursor;
+      dotenv_span key, value;
+
+      if (!dotenv_parse_line(&line, line_end, &key, &value)) {
+        cursor = newline ? newline + 1 : end;
+        continue;
+      }
+
+      if (dotenv_entry_init(var, key, value, arena) == -1)
+        return -1;
+    }
+
+    lines->hashes[table->var_count] = hash;
+    lines->offsets[table->var_count] = (size_t)(cursor - file->data);
+    lines->lengths[table->var_count] = len;
+    table->var_count++;
+    dotenv_index_insert(table, table->var_count - 1);
+
+    cursor = newline ? newline + 1 : end;
+  }
+
+  return dotenv_lines_build(lines, table->var_count);
+}
+
+/**
+ * @brief Finds the reused entries whose value must be interpolated again.
+ *
+ * An entry must be resolved again if one of its placeholders now names
+ * another entry than in the previous load, or a key defined outside the file,
+ * or an entry that must itself be resolved again. The references are
+ * inverted into an adjacency array, and the dirty entries are propagated to
+ * their dependents breadth-first, so the pass is linear in the number of
+ * placeholders. Dirty entries get an empty value and a fresh cache; newly
+ * tokenized entries are dirty from the start.
+ *
+ * @param table The tokenized entries.
+ * @param old The entries of the previous load (may be NULL).
+ * @param arena The arena receiving the fresh caches.
+ * @return 0 on success, -1 if memory allocation fails.
+ */
+static int dotenv_mark_dirty(dotenv_table *table, const dotenv_table *old,
+                             dotenv_arena *arena) {
+  int count = table->var_count;
+  int *offsets = calloc(count + 1, sizeof(int));
+  int *queue = malloc(sizeof(int) * (count ? count : 1));
+  unsigned char *dirty = calloc(count ? count : 1, 1);
+  int *dependents = NULL;
+  int result = -1;
+
+  if (!offsets || !queue || !dirty) {
+    perror("Failed to allocate memory for interpolation.");
+    goto done;
+  }
+
+  // The first pass counts the dependents of each entry, the second one
+  // stores them, using the queue as the fill position of each entry
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < count; i++) {
+      const env_var *var = &table->vars[i];
+      const char *cursor = var->raw;
+      const char *end = cursor + var->raw_len;
+      const char *start;
+      dotenv_span name;
+
+      if (!var->value && !var->cache->scope) {
+        dirty[i] = 1;
+      }
+
+      while (dotenv_next_placeholder(cursor, end, &start, &name)) {
+        uint64_t hash = dotenv_hash(name.ptr, name.len);
+        int pos = dotenv_index_find(table, name.ptr, name.len, hash);
+
+        cursor = name.ptr + name.len + 1;
+
+        // Self references read a fixed table and never change
+        if (pos == i)
+          continue;
+
+        if (pos == -1) {
+          dirty[i] = 1;
+          continue;
+        }
+
+        if (pass == 1) {
+          dependents[queue[pos]++] = i;
+          continue;
+        }
+
+        int before = dotenv_index_find(old, name.ptr, name.len, hash);
+
+        if (before == -1 || old->vars[before].cache != table->vars[pos].cache) {
+          dirty[i] = 1;
+        }
+
+        offsets[pos + 1]++;
+      }
+    }
+
+    if (pass == 0) {
+      for (int i = 0; i < count; i++) {
+        offsets[i + 1] += offsets[i];
+        queue[i] = offsets[i];
+      }
+
+      dependents = malloc(sizeof(int) * (offsets[count] ? offsets[count] : 1));
+
+      if (!dependents) {
+        perror("Failed to allocate memory for interpolation.");
+        goto done;
+      }
+    }
+  }
+
+  int head = 0;
+  int tail = 0;
+
+  for (int i = 0; i < count; i++) {
+    if (dirty[i]) {
+      queue[tail++] = i;
+    }
+  }
+
+  while (head < tail) {
+    int pos = queue[head++];
+
+    for (int j = offsets[pos]; j < offsets[pos + 1]; j++) {
+      if (!dirty[dependents[j]]) {
+        dirty[dependents[j]] = 1;
+        queue[tail++] = dependents[j];
+      }
+    }
+  }
+
+  for (int i = 0; i < count; i++) {
+    env_var *var = &table->vars[i];
 
-/**
- * @struct env_var
- * @brief Structure representing an environment variable.
- *
- * Contains a key-value pair for an environment variable.
- */
-typedef struct {
-  char *key;   ///< The key of the environment variable.
-  char *value; ///< The value associated with the key.
-} env_var;
+    if (!dirty[i] || (!var->value && !var->cache->scope))
+      continue;
 
-/**
- * @struct dotenv_context
- * @brief Internal structure to manage environment variables.
- *
- * Holds the loaded variables, their count, and the allocated capacity.
- */
-typedef struct {
-  env_var *vars;         ///< Dynamic array of environment variables.
-  int var_count;         ///< Number of currently loaded variables.
-  int capacity;          ///< Capacity of the dynamic array.
-  pthread_mutex_t mutex; ///< Mutex to ensure thread-safe access.
-} dotenv_context;
+    var->value = NULL;
+    var->cache = dotenv_cache_create(arena);
 
-/// Internal context to manage the loaded variables (hidden from the user).
-static dotenv_context ctx = {NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER};
+    if (!var->cache) {
+      perror("Failed to allocate memory for interpolation.");
+      goto done;
+    }
+  }
+
+  result = 0;
+
+done:
+  free(offsets);
+  free(queue);
+  free(dirty);
+  free(dependents);
+  return result;
+}
 
 /**
- * @brief Removes leading and trailing whitespace from a string,
- *        and also removes leading and trailing double quotes if present.
+ * @brief Brings back the definitions a watched file stops overriding.
  *
- * Modifies the string in place to remove any spaces, tabs, or newline
- * characters from the beginning and the end. It also removes quotes at the
- * start and end of the string, if they exist.
+ * A key that the previous version of the file defined but this one does not
+ * is dropped from the published table along with the file's old entries. If
+ * the file was first loaded over a definition of that key, a copy of that
+ * definition is appended to the new entries, so the key reverts to it. The
+ * copy keeps its value and cache, so dependents see the earlier value.
  *
- * @param str The string to trim.
- * @return A pointer to the trimmed string.
+ * @param table The tokenized entries of this version.
+ * @param old The entries of the previous version (may be NULL).
+ * @param previous The table the file was first loaded over.
+ * @return 0 on success, -1 if memory allocation fails.
  */
-static char *trim_whitespace(char *str) {
-  char *end;
+static int dotenv_restore_removed(dotenv_table *table, const dotenv_table *old,
+                                  const dotenv_table *previous) {
+  for (int i = 0; old && i < old->var_count; i++) {
+    const env_var *var = &old->vars[i];
 
-  // Trim leading spaces
-  while (*str == ' ' || *str == '\t' || *str == '\n' || *str == '\r') {
-    str++;
-  }
+    if (dotenv_index_find(old, var->key, var->key_len, var->hash) != i ||
+        dotenv_index_find(table, var->key, var->key_len, var->hash) != -1)
+      continue;
 
-  // If the string is now empty, return it
-  if (*str == '\0') {
-    return str;
-  }
+    int pos = dotenv_index_find(previous, var->key, var->key_len, var->hash);
 
-  // Trim trailing spaces
-  end = str + strlen(str) - 1;
+    if (pos == -1)
+      continue;
 
-  while (end > str &&
-         (*end == ' ' || *end == '\t' || *end == '\n' || *end == '\r')) {
-    end--;
-  }
+    const env_var *earlier = &previous->vars[pos];
+    const char *value = dotenv_var_value(earlier);
+
+    // Values depending on a cycle are not found anyway
+    if (!value)
+      continue;
 
-  // Null-terminate the string
-  *(end + 1) = '\0';
+    if (table->var_count == table->capacity && dotenv_resize(table) == -1)
+      return -1;
 
-  // Remove leading and trailing quotes if present
-  if (*str == '"') {
-    str++;
-  }
+    env_var *restored = &table->vars[table->var_count];
 
-  if (*end == '"') {
-    *end = '\0';
+    *restored = *earlier;
+    restored->value = (char *)value;
+    restored->value_len = dotenv_var_length(earlier);
+    table->var_count++;
+
+    if (dotenv_index_insert(table, table->var_count - 1) == -1)
+      return -1;
   }
 
-  return str;
+  return 0;
 }
 
 /**
- * @brief Removes the comment from a line (everything after #), but respects
- * comments inside quoted strings.
+ * @brief Reads a whole file into a private heap buffer.
  *
- * @param str The string to process.
- * @return The string without the comment (everything after #), unless inside
- * quotes.
+ * Used for watched files instead of `dotenv_map_file`: they are rewritten in
+ * place by editors and deploy tools, and a mapping of a file truncated while
+ * it is parsed faults with SIGBUS. The file is read until end of file, so a
+ * file that changes size meanwhile still yields a consistent buffer.
+ *
+ * @param filename Path to the file.
+ * @param file Receives the file contents, to be released with `free`.
+ * @return 0 on success, -1 if the file cannot be opened or read.
  */
-static char *remove_comment(char *str) {
-  char *comment_pos = NULL;
-  int inside_quotes = 0;
+static int dotenv_read_file(const char *filename, dotenv_file *file) {
+  file->data = NULL;
+  file->size = 0;
 
-  for (char *current = str; *current != '\0'; current++) {
-    if (*current == '"') {
-      inside_quotes = !inside_quotes; // Toggle inside_quotes state
-    }
+  int fd = open(filename, O_RDONLY);
+
+  if (fd == -1)
+    return -1;
+
+  // The size is only a hint, one spare byte detects a file that grew
+  struct stat st;
+  size_t capacity =
+      fstat(fd, &st) == 0 && st.st_size > 0 ? (size_t)st.st_size + 1 : 4096;
+  char *data = malloc(capacity);
+  size_t size = 0;
+
+  while (data) {
+    ssize_t count = read(fd, data + size, capacity - size);
 
-    if (!inside_quotes && *current == '#') {
-      comment_pos = current;
+    if (count == 0)
       break;
+
+    if (count == -1 && errno == EINTR)
+      continue;
+
+    if (count == -1) {
+      free(data);
+      close(fd);
+      return -1;
+    }
+
+    size += (size_t)count;
+
+    if (size == capacity) {
+      char *grown = realloc(data, capacity * 2);
+
+      if (!grown) {
+        free(data);
+      }
+
+      data = grown;
+      capacity *= 2;
     }
   }
 
-  if (comment_pos) {
-    *comment_pos = '\0'; // Terminate the string before the #
+  close(fd);
+
+  if (!data)
+    return -1;
+
+  if (size == 0) {
+    free(data);
+    return 0;
   }
 
-  return str;
+  file->data = data;
+  file->size = size;
+  return 0;
 }
 
 /**
- * @brief Initializes the internal dotenv context.
+ * @struct dotenv_watcher
+ * @brief State of the thread reloading a watched file.
+ */
+typedef struct {
+  char *filename;               ///< Path of the watched file.
+  const char *name;             ///< Name of the file within its directory.
+  unsigned flags;               ///< `DOTENV_LOAD_*` options used on every load.
+  dotenv_table *entries;        ///< Entries of the published version.
+  dotenv_lines lines;           ///< Lines of those entries.
+  const dotenv_table *previous; ///< Table the file was first loaded over.
+  int inotify_fd;               ///< inotify instance watching the directory.
+  int wake[2];                  ///< Pipe used to stop the thread.
+  pthread_t thread;             ///< The reloading thread.
+  int active;                   ///< Whether a file is watched.
+  pthread_mutex_t mutex;        ///< Mutex serializing watch and unwatch.
+} dotenv_watcher;
+
+/// The watched file (hidden from the user).
+static dotenv_watcher watcher = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+/// Empty table, for a file watched before anything else was loaded.
+static const dotenv_table dotenv_no_previous;
+
+/**
+ * @brief Loads the watched file and replaces the entries of its previous
+ * version.
  *
- * Ensures the internal context is ready for use.
+ * Only lines that changed since the previous load are tokenized, and only
+ * values depending on changed keys are interpolated again; everything else
+ * reuses the storage of the previous version. The file is read into a
+ * private buffer, so rewriting it in place during a reload cannot fault. The
+ * staging entries of the previous version are freed, since the published
+ * table holds copies of them and is reclaimed like any other once superseded.
+ * Self references keep reading the definitions the file was first loaded
+ * over, so a value such as `PATH=${PATH}:/opt/bin` does not grow on every
+ * reload.
  *
- * @param initial_capacity Initial capacity for the environment variable array.
- * @return 0 on success, -1 if memory allocation fails.
+ * @return 0 on success, -1 if the file cannot be read, holds a reference
+ * cycle or memory allocation fails.
  */
-static int dotenv_init(int initial_capacity) {
-  pthread_mutex_lock(&ctx.mutex);
+static int dotenv_watch_load(void) {
+  dotenv_source source = {
+      watcher.filename, watcher.flags, NULL, {NULL, NULL}, -1, NULL};
+  dotenv_lines lines = {NULL, NULL, NULL, NULL, 0, NULL};
+  dotenv_file file;
 
-  if (ctx.vars == NULL) { // Only initialize if not already done
-    ctx.vars = malloc(sizeof(env_var) * initial_capacity);
+  if (dotenv_read_file(watcher.filename, &file) == -1) {
+    perror("Failed to open .env file.");
+    return -1;
+  }
 
-    if (!ctx.vars) {
-      perror("Failed to allocate memory for environment variables.");
-      pthread_mutex_unlock(&ctx.mutex);
-      return -1;
+  // Kept with the lines, to compare them with the next version
+  lines.data = (char *)file.data;
+
+  source.table = dotenv_table_create(dotenv_count_lines(file.data, file.size));
+
+  int result = source.table ? 0 : -1;
+
+  if (result == 0) {
+    result = dotenv_tokenize_lines(&file, source.table, &source.arena,
+                                   watcher.entries, &watcher.lines, &lines);
+  }
+
+  if (result == 0) {
+    result = dotenv_mark_dirty(source.table, watcher.entries, &source.arena);
+  }
+
+  // Appended after marking, since restored values are already resolved
+  if (result == 0) {
+    result = dotenv_restore_removed(source.table, watcher.entries,
+                                    watcher.previous);
+  }
+
+  if (result == 0) {
+    result = dotenv_apply_source(&source, 1, watcher.entries, watcher.previous);
+  }
+
+  if (result == 0) {
+    // Only this thread reads the entries; their copies were published
+    if (watcher.entries) {
+      dotenv_table_destroy(watcher.entries);
     }
 
-    ctx.var_count = 0;
-    ctx.capacity = initial_capacity;
+    dotenv_lines_release(&watcher.lines);
+    watcher.entries = source.table;
+    watcher.lines = lines;
+    source.table = NULL;
+  } else {
+    dotenv_lines_release(&lines);
   }
 
-  pthread_mutex_unlock(&ctx.mutex);
-  return 0;
+  dotenv_source_release(&source);
+  return result;
 }
 
 /**
- * @brief Resizes the internal array of environment variables.
+ * @brief Waits for changes to the watched file and reloads it.
  *
- * Doubles the capacity to accommodate more variables when needed.
+ * Events are drained in batches, so a burst of writes causes one reload.
  *
- * @return 0 on success, -1 if memory allocation fails.
+ * @param arg Unused.
+ * @return NULL.
+ */
+static void *dotenv_watch_thread(void *arg) {
+  union {
+    struct inotify_event event;
+    char bytes[4096];
+  } buffer;
+  struct pollfd fds[2] = {{watcher.inotify_fd, POLLIN, 0},
+                          {watcher.wake[0], POLLIN, 0}};
+
+  (void)arg;
+
+  for (;;) {
+    if (poll(fds, 2, -1) == -1) {
+      if (errno == EINTR)
+        continue;
+
+      perror("Failed to wait for .env file changes.");
+      return NULL;
+    }
+
+    if (fds[1].revents)
+      return NULL;
+
+    ssize_t length = read(watcher.inotify_fd, buffer.bytes, sizeof(buffer));
+
+    if (length <= 0) {
+      if (length == -1 && errno == EINTR)
+        continue;
+
+      perror("Failed to read .env file changes.");
+      return NULL;
+    }
+
+    int changed = 0;
+
+    for (const char *p = buffer.bytes; p < buffer.bytes + length;) {
+      const struct inotify_event *event = (const struct inotify_event *)p;
+
+      if ((event->mask & IN_Q_OVERFLOW) ||
+          (event->len && strcmp(event->name, watcher.name) == 0)) {
+        changed = 1;
+      }
+
+      p += sizeof(struct inotify_event) + event->len;
+    }
+
+    if (changed) {
+      dotenv_watch_load();
+    }
+  }
+}
+
+/**
+ * @brief Closes the descriptors of the watcher and forgets the file.
  */
-static int dotenv_resize() {
+static void dotenv_watch_close(void) {
+  if (watcher.inotify_fd != -1) {
+    close(watcher.inotify_fd);
+  }
+
+  if (watcher.wake[0] != -1) {
+    close(watcher.wake[0]);
+    close(watcher.wake[1]);
+  }
+
+  dotenv_lines_release(&watcher.lines);
+  free(watcher.filename);
+  watcher.filename = NULL;
+
+  // The snapshot of previous definitions may now be reclaimed
   pthread_mutex_lock(&ctx.mutex);
+  ctx.pinned = NULL;
+  pthread_mutex_unlock(&ctx.mutex);
+}
 
-  int new_capacity = ctx.capacity * 2;
-  env_var *new_vars = realloc(ctx.vars, sizeof(env_var) * new_capacity);
+int dotenv_watch(const char *filename, unsigned flags) {
+  pthread_mutex_lock(&watcher.mutex);
 
-  if (!new_vars) {
-    perror("Failed to resize environment variable array.");
-    pthread_mutex_unlock(&ctx.mutex);
+  if (watcher.active) {
+    fprintf(stderr, "A .env file is already watched.\n");
+    pthread_mutex_unlock(&watcher.mutex);
+    return -1;
+  }
+
+  size_t len = strlen(filename);
+  const char *slash = strrchr(filename, '/');
+
+  watcher.filename = malloc(len + 1);
+  watcher.flags = flags;
+  watcher.entries = NULL;
+  watcher.lines = (dotenv_lines){NULL, NULL, NULL, NULL, 0, NULL};
+  watcher.inotify_fd = -1;
+  watcher.wake[0] = watcher.wake[1] = -1;
+
+  if (!watcher.filename) {
+    perror("Failed to allocate memory for the watched file.");
+    pthread_mutex_unlock(&watcher.mutex);
+    return -1;
+  }
+
+  memcpy(watcher.filename, filename, len + 1);
+  watcher.name = slash ? watcher.filename + (slash - filename) + 1
+                       : watcher.filename;
+
+  // Watch the directory, so that files renamed over the watched one are seen
+  char *directory = malloc(len + 2);
+
+  if (!directory) {
+    perror("Failed to allocate memory for the watched file.");
+    dotenv_watch_close();
+    pthread_mutex_unlock(&watcher.mutex);
+    return -1;
+  }
+
+  if (!slash) {
+    memcpy(directory, ".", 2);
+  } else if (slash == filename) {
+    memcpy(directory, "/", 2);
+  } else {
+    memcpy(directory, filename, slash - filename);
+    directory[slash - filename] = '\0';
+  }
+
+  watcher.inotify_fd = inotify_init1(IN_CLOEXEC);
+
+  int watched = watcher.inotify_fd != -1 &&
+                inotify_add_watch(watcher.inotify_fd, directory,
+                                  IN_CLOSE_WRITE | IN_MOVED_TO) != -1;
+
+  free(directory);
+
+  if (!watched || pipe(watcher.wake) == -1) {
+    perror("Failed to watch .env file.");
+    dotenv_watch_close();
+    pthread_mutex_unlock(&watcher.mutex);
     return -1;
   }
 
-  ctx.vars = new_vars;
-  ctx.capacity = new_capacity;
+  // Changes made from here on are caught by the watch
+  pthread_mutex_lock(&ctx.mutex);
+
+  const dotenv_table *current =
+      atomic_load_explicit(&ctx.table, memory_order_relaxed);
 
+  watcher.previous = current ? current : &dotenv_no_previous;
+  ctx.pinned = watcher.previous;
   pthread_mutex_unlock(&ctx.mutex);
+
+  if (dotenv_watch_load() == -1) {
+    dotenv_watch_close();
+    pthread_mutex_unlock(&watcher.mutex);
+    return -1;
+  }
+
+  if (pthread_create(&watcher.thread, NULL, dotenv_watch_thread, NULL) != 0) {
+    fprintf(stderr, "Failed to start the .env file watcher.\n");
+    dotenv_table_destroy(watcher.entries);
+    watcher.entries = NULL;
+    dotenv_watch_close();
+    pthread_mutex_unlock(&watcher.mutex);
+    return -1;
+  }
+
+  watcher.active = 1;
+  pthread_mutex_unlock(&watcher.mutex);
   return 0;
 }
 
+void dotenv_unwatch(void) {
+  pthread_mutex_lock(&watcher.mutex);
+
+  if (watcher.active) {
+    // The thread wakes up on the pipe and exits
+    while (write(watcher.wake[1], "", 1) == -1 && errno == EINTR) {
+    }
+
+    pthread_join(watcher.thread, NULL);
+    dotenv_table_destroy(watcher.entries);
+    watcher.entries = NULL;
+    watcher.active = 0;
+    dotenv_watch_close();
+  }
+
+  pthread_mutex_unlock(&watcher.mutex);
+}
+#else
+int dotenv_watch(const char *filename, unsigned flags) {
+  (void)filename;
+  (void)flags;
+
+  fprintf(stderr, "Watching .env files is not supported on this platform.\n");
+  return -1;
+}
+
+void dotenv_unwatch(void) {}
+#endif
+
+#ifndef _WIN32
 /**
- * @brief Retrieves the value associated with a specific key.
+ * @brief Builds the `KEY=VALUE` string of an exported variable.
  *
- * Searches for the value of a key previously loaded from the `.env` file.
+ * The string is preceded in the export arena by the environment entry it
+ * replaces, so `dotenv_unexport` can put that entry back. The caller must
+ * hold `ctx.mutex`.
  *
- * @param key The key of the variable to search for.
- * @return The value associated with the key, or `NULL` if the key is not found.
+ * @param var The variable.
+ * @param value Its value.
+ * @param value_len The length of the value.
+ * @param replaced The original entry for the key, or NULL if it is added.
+ * @return The string, or NULL if memory allocation fails.
  */
-const char *dotenv_get(const char *key) {
-  pthread_mutex_lock(&ctx.mutex);
+static char *dotenv_export_pair(const env_var *var, const char *value,
+                                size_t value_len, char *replaced) {
+  size_t key_len = var->key_len;
+  char *header = dotenv_arena_alloc(
+      &ctx.export_arena, sizeof(char *) + key_len + value_len + 2,
+      _Alignof(char *));
 
-  for (int i = 0; i < ctx.var_count; i++) {
-    if (strcmp(ctx.vars[i].key, key) == 0) {
-      pthread_mutex_unlock(&ctx.mutex);
-      return ctx.vars[i].value;
-    }
+  if (!header) {
+    perror("Failed to allocate memory for exported variables.");
+    return NULL;
   }
 
-  pthread_mutex_unlock(&ctx.mutex);
-  return NULL;
+  char *pair = header + sizeof(char *);
+
+  memcpy(header, &replaced, sizeof(char *));
+  memcpy(pair, var->key, key_len);
+  pair[key_len] = '=';
+  memcpy(pair + key_len + 1, value, value_len + 1);
+
+  return pair;
 }
 
 /**
- * @brief Replaces occurrences of `${var}` in a string with their corresponding
- * values.
+ * @brief Returns the original entry behind an environment entry.
  *
- * Dynamically allocates a new string with the resolved variables.
+ * The caller must hold `ctx.mutex`.
  *
- * @param str The input string with potential `${var}` placeholders.
- * @return A new string with the variables resolved, or NULL on error.
+ * @param entry An entry of `environ`.
+ * @return The entry itself if `dotenv_export` did not build it, otherwise
+ * the entry it replaced, or NULL if it added the key.
  */
-static char *resolve_variables(const char *str) {
-  if (!str)
-    return NULL;
+static char *dotenv_export_original(char *entry) {
+  uintptr_t address = (uintptr_t)entry;
 
-  char *result = malloc(strlen(str) + 1);
+  for (const dotenv_arena_block *block = ctx.export_arena.head; block;
+       block = block->next) {
+    uintptr_t start = (uintptr_t)block->data;
 
-  if (!result)
-    return NULL;
+    if (address >= start && address < start + block->used) {
+      char *replaced;
 
-  result[0] = '\0';
+      memcpy(&replaced, entry - sizeof(char *), sizeof(char *));
+      return replaced;
+    }
+  }
 
-  const char *current = str;
+  return entry;
+}
 
-  while (*current) {
-    if (strncmp(current, "${", 2) == 0) {
-      // Find the closing '}'
-      const char *end = strchr(current, '}');
+/**
+ * @brief Takes the exported variables back out of the process environment.
+ *
+ * The program may have called `setenv` or `unsetenv` since the export, which
+ * either edits the installed array in place or moves to a copy of it, so the
+ * current `environ` is edited in place: every entry built by `dotenv_export`
+ * is replaced by the entry it replaced, or removed if it added the key, and
+ * every other entry is kept. The caller must hold `ctx.mutex`.
+ */
+static void dotenv_unexport(void) {
+  size_t kept = 0;
 
-      if (!end)
-        break;
+  for (size_t i = 0; environ && environ[i]; i++) {
+    char *entry = dotenv_export_original(environ[i]);
 
-      // Extract the variable name
-      char var_name[256];
-      size_t var_len = end - current - 2;
+    if (entry) {
+      environ[kept++] = entry;
+    }
+  }
 
-      if (var_len >= sizeof(var_name))
-        var_len = sizeof(var_name) - 1;
+  if (environ) {
+    environ[kept] = NULL;
+  }
 
-      strncpy(var_name, current + 2, var_len);
-      var_name[var_len] = '\0';
+  char **original = ctx.original_environ;
 
-      // Lookup the variable value
-      const char *value = dotenv_get(var_name);
+  if (environ != ctx.exported) {
+    // The environment moved to a copy; the installed array is unused
+    free(ctx.exported);
+    ctx.exported = NULL;
+  } else if (original) {
+    size_t same = 0;
 
-      if (value) {
-        strcat(result, value);
-      }
+    // The replaced array is only valid while ours is installed
+    while (environ[same] && environ[same] == original[same]) {
+      same++;
+    }
 
-      current = end + 1;
-    } else {
-      // Append the current character
-      size_t len = strlen(result);
-      result[len] = *current;
-      result[len + 1] = '\0';
-      current++;
+    // Unchanged since the export, so the replaced array can come back
+    if (!environ[same] && !original[same]) {
+      environ = original;
+      free(ctx.exported);
+      ctx.exported = NULL;
     }
   }
 
-  return result;
+  // Otherwise the installed array stays the environment, and is freed by
+  // the next export or once the program moves off it
+  ctx.original_environ = NULL;
+  dotenv_arena_release(&ctx.export_arena);
 }
 
-/// Maximum length of a line in the .env file.
-#define MAX_LINE_LENGTH 1024
-
-/**
- * @brief Loads environment variables from a `.env` file using a stream
- * approach, with variable interpolation.
- *
- * Processes the file line by line, storing key-value pairs without loading the
- * entire file into memory.
- *
- * @param filename Path to the `.env` file.
- * @return 0 if the file is successfully loaded, -1 if the file cannot be
- * opened.
- */
-int dotenv_load(const char *filename) {
-  if (dotenv_init(10) == -1)
-    return -1;
+int dotenv_export(unsigned flags) {
+  pthread_mutex_lock(&ctx.mutex);
 
-  FILE *file = fopen(filename, "r");
+  const dotenv_table *table =
+      atomic_load_explicit(&ctx.table, memory_order_relaxed);
+  int count = table ? table->var_count : 0;
+  size_t env_count = 0;
 
-  if (!file) {
-    perror("Failed to open .env file.");
-    return -1;
+  while (environ && environ[env_count]) {
+    env_count++;
   }
 
-  char line[MAX_LINE_LENGTH];
+  char **array = malloc(sizeof(char *) * (env_count + count + 1));
+  unsigned char *seen = calloc(count ? count : 1, 1);
+  size_t n = 0;
 
-  while (fgets(line, sizeof(line), file)) {
-    char *newline_pos = strstr(line, ENV_NEWLINE);
+  if (!array || !seen) {
+    perror("Failed to allocate memory for exported variables.");
+    goto fail;
+  }
 
-    if (newline_pos) {
-      *newline_pos = '\0';
-    } else {
-      char *single_newline = strchr(line, '\n');
+  // Keep the environment in order, substituting the loaded values
+  for (size_t i = 0; i < env_count; i++) {
+    char *entry = environ[i];
+    const char *equals = strchr(entry, '=');
+    size_t len = equals ? (size_t)(equals - entry) : strlen(entry);
+    int pos = dotenv_index_find(table, entry, len, dotenv_hash(entry, len));
 
-      if (single_newline) {
-        *single_newline = '\0';
-      }
-    }
+    array[n++] = entry;
 
-    if (line[0] == '#' || line[0] == '\0')
+    if (pos == -1 || seen[pos])
       continue;
 
-    // Remove the comment if present
-    remove_comment(line);
+    seen[pos] = 1;
 
-    char *delimiter = strchr(line, '=');
+    const char *value = (flags & DOTENV_EXPORT_OVERWRITE)
+                            ? dotenv_expand_locked(&table->vars[pos])
+                            : NULL;
 
-    if (!delimiter)
-      continue;
+    if (value) {
+      array[n - 1] = dotenv_export_pair(
+          &table->vars[pos], value, dotenv_var_length(&table->vars[pos]),
+          dotenv_export_original(entry));
+
+      if (!array[n - 1])
+        goto fail;
+    }
+  }
 
-    *delimiter = '\0';
-    char *key = trim_whitespace(line);
-    char *value = trim_whitespace(delimiter + 1);
+  // Then add the loaded keys the environment did not have
+  for (int i = 0; i < count; i++) {
+    const env_var *var = &table->vars[i];
 
-    if (key[0] == '\0')
+    if (seen[i] ||
+        dotenv_index_find(table, var->key, var->key_len, var->hash) != i)
       continue;
 
-    // Resolve interpolated variables in value
-    char *resolved_value = resolve_variables(value);
+    const char *value = dotenv_expand_locked(var);
 
-    pthread_mutex_lock(&ctx.mutex);
+    if (!value)
+      continue;
 
-    if (ctx.var_count >= ctx.capacity) {
-      if (dotenv_resize() == -1) {
-        pthread_mutex_unlock(&ctx.mutex);
-        fclose(file);
-        free(resolved_value);
-        return -1;
-      }
-    }
+    array[n] = dotenv_export_pair(var, value, dotenv_var_length(var), NULL);
 
-    ctx.vars[ctx.var_count].key = strdup(key);
-    ctx.vars[ctx.var_count].value =
-        resolved_value ? resolved_value : strdup(value);
+    if (!array[n++])
+      goto fail;
+  }
 
-    if (!ctx.vars[ctx.var_count].key || !ctx.vars[ctx.var_count].value) {
-      perror("Failed to allocate memory for key or value.");
-      pthread_mutex_unlock(&ctx.mutex);
-      fclose(file);
-      return -1;
-    }
+  array[n] = NULL;
 
-    ctx.var_count++;
-    pthread_mutex_unlock(&ctx.mutex);
+  // The program may have called setenv since, which leaves the array it
+  // replaced to be reallocated, so only the current one can be restored
+  if (environ != ctx.exported) {
+    ctx.original_environ = environ;
   }
 
-  fclose(file);
+  // The previous array is no longer referenced once replaced
+  free(ctx.exported);
+  environ = array;
+  ctx.exported = array;
+
+  free(seen);
+  pthread_mutex_unlock(&ctx.mutex);
   return 0;
+
+fail:
+  free(array);
+  free(seen);
+  pthread_mutex_unlock(&ctx.mutex);
+  return -1;
 }
+#else
+int dotenv_export(unsigned flags) {
+  (void)flags;
 
-/**
- * @brief Frees the memory allocated for loaded environment variables.
- *
- * Releases the memory allocated for keys, values, and the internal context.
- */
-void dotenv_free() {
+  fprintf(stderr, "Exporting variables is not supported on this platform.\n");
+  return -1;
+}
+#endif
+
+void dotenv_free(void) {
+  dotenv_unwatch();
   pthread_mutex_lock(&ctx.mutex);
 
-  if (ctx.vars) {
-    for (int i = 0; i < ctx.var_count; i++) {
-      free(ctx.vars[i].key);
-      free(ctx.vars[i].value);
-    }
+  dotenv_table *table = atomic_load_explicit(&ctx.table, memory_order_relaxed);
+
+  if (table) {
+    dotenv_table_destroy(table);
+    atomic_store_explicit(&ctx.table, NULL, memory_order_release);
+  }
+
+  while (ctx.retired) {
+    dotenv_table *next = ctx.retired->next_retired;
+    dotenv_table_destroy(ctx.retired);
+    ctx.retired = next;
+  }
 
-    free(ctx.vars);
+  for (int i = 0; i < DOTENV_SLOT_CHUNKS; i++) {
+    free(atomic_load_explicit(&ctx.slot_chunks[i], memory_order_relaxed));
+    atomic_store_explicit(&ctx.slot_chunks[i], NULL, memory_order_release);
+  }
+
+  free(ctx.slot_index);
+  ctx.slot_index = NULL;
+  ctx.slot_index_capacity = 0;
+  ctx.slot_count = 0;
+
+#ifndef _WIN32
+  if (ctx.exported) {
+    dotenv_unexport();
+  }
+#endif
+
+  dotenv_thaw_locked();
+
+  while (ctx.thawed) {
+    dotenv_frozen *next = ctx.thawed->next_retired;
+    dotenv_phash_release(&ctx.thawed->phash);
+    free(ctx.thawed->entries);
+    free(ctx.thawed);
+    ctx.thawed = next;
+  }
 
-    ctx.vars = NULL;
-    ctx.var_count = 0;
-    ctx.capacity = 0;
+  // Published values may point into the images until their tables are gone
+  while (ctx.images) {
+    dotenv_image *next = ctx.images->next;
+    dotenv_unmap_file(&ctx.images->file);
+    free(ctx.images->caches);
+    free(ctx.images);
+    ctx.images = next;
   }
 
+  dotenv_arena_release(&ctx.arena);
   pthread_mutex_unlock(&ctx.mutex);
 }
 
-#endif // CENV_H
\ No newline at end of file
+#endif // CENV_IMPLEMENTATION_INCLUDED
+#endif // CENV_IMPLEMENTATION
@@ -0,0 +1,2 @@
+#define CENV_IMPLEMENTATION
+#include "cenv.h"
@@ -0,0 +1,143 @@
+/**
+ * @file cenv_test.h
+ * @brief Helpers shared by the regression tests.
+ *
+ * Each test is a standalone program built with sanitizers by `make test`. It
+ * prints every failed check and exits with a non-zero status if any failed.
+ */
+#ifndef CENV_TEST_H
+#define CENV_TEST_H
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <cenv.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/// Longest time a test waits for a reload to be published, in milliseconds.
+#define CENV_TEST_TIMEOUT_MS 5000
+
+/// Number of failed checks so far.
+static int cenv_test_failures;
+
+/// Reports a failed check without stopping the test.
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,         \
+              #condition);                                                     \
+      cenv_test_failures++;                                                    \
+    }                                                                          \
+  } while (0)
+
+/**
+ * @brief Compares two possibly missing strings.
+ *
+ * @param a The first string (may be NULL).
+ * @param b The second string (may be NULL).
+ * @return 1 if both are missing or both hold the same bytes, 0 otherwise.
+ */
+static inline int cenv_test_equal(const char *a, const char *b) {
+  return a == b || (a && b && strcmp(a, b) == 0);
+}
+
+/**
+ * @brief Checks the value of a key, reporting where the check is made.
+ *
+ * @param file The source file of the check.
+ * @param line The line of the check.
+ * @param key The key.
+ * @param expected The value it must have, or NULL if it must be missing.
+ */
+static inline void cenv_test_check_value(const char *file, int line,
+                                         const char *key,
+                                         const char *expected) {
+  const char *actual = dotenv_get(key);
+
+  if (!cenv_test_equal(actual, expected)) {
+    fprintf(stderr, "%s:%d: %s is \"%s\", expected \"%s\"\n", file, line, key,
+            actual ? actual : "(null)", expected ? expected : "(null)");
+    cenv_test_failures++;
+  }
+}
+
+/// Checks the value of a key, NULL meaning that it must be missing.
+#define CHECK_VALUE(key, expected)                                             \
+  cenv_test_check_value(__FILE__, __LINE__, key, expected)
+
+/**
+ * @brief Sleeps for a number of milliseconds.
+ *
+ * @param ms The duration.
+ */
+static inline void cenv_test_sleep_ms(long ms) {
+  struct timespec ts = {ms / 1000, ms % 1000 * 1000000L};
+
+  nanosleep(&ts, NULL);
+}
+
+/**
+ * @brief Replaces a file with new contents in one rename.
+ *
+ * @param path The file.
+ * @param contents Its new contents.
+ * @return 0 on success, -1 if the file cannot be written.
+ */
+static inline int cenv_test_write(const char *path, const char *contents) {
+  char temp[4096];
+  FILE *file;
+
+  snprintf(temp, sizeof(temp), "%s.tmp", path);
+  file = fopen(temp, "w");
+
+  if (!file) {
+    perror("Failed to write test file");
+    return -1;
+  }
+
+  fputs(contents, file);
+  fclose(file);
+  return rename(temp, path);
+}
+
+/**
+ * @brief Waits until a key holds a value, for instance after a reload.
+ *
+ * @param key The key.
+ * @param expected The value to wait for, or NULL to wait for the key to go.
+ * @return 1 if the value showed up in time, 0 otherwise.
+ */
+static inline int cenv_test_wait(const char *key, const char *expected) {
+  for (int waited = 0; waited < CENV_TEST_TIMEOUT_MS; waited += 5) {
+    if (cenv_test_equal(dotenv_get(key), expected))
+      return 1;
+
+    cenv_test_sleep_ms(5);
+  }
+
+  fprintf(stderr, "Timed out waiting for %s to become \"%s\"\n", key,
+          expected ? expected : "(null)");
+  return 0;
+}
+
+/**
+ * @brief Creates a private directory for the files of a test.
+ *
+ * @param path Receives the directory, at least 32 bytes.
+ * @return 0 on success, -1 if the directory cannot be created.
+ */
+static inline int cenv_test_directory(char *path) {
+  strcpy(path, "/tmp/cenv_test_XXXXXX");
+
+  if (!mkdtemp(path)) {
+    perror("Failed to create test directory");
+    return -1;
+  }
+
+  return 0;
+}
+
+#endif // CENV_TEST_H
@@ -0,0 +1,70 @@
+/**
+ * @file test_compiled.c
+ * @brief Compiled images, adopted as the published table or merged into it.
+ */
+#include "cenv_test.h"
+
+int main(void) {
+  char directory[32];
+  char source[64];
+  char image[64];
+  char other[64];
+
+  if (cenv_test_directory(directory) == -1)
+    return 1;
+
+  snprintf(source, sizeof(source), "%s/app.env", directory);
+  snprintf(image, sizeof(image), "%s/app.envc", directory);
+  snprintf(other, sizeof(other), "%s/other.env", directory);
+
+  if (cenv_test_write(source, "HOST=db\nURL=${HOST}:5432\nN=42\nN=7\n") ==
+          -1 ||
+      cenv_test_write(other, "HOST=local\nEXTRA=1\n") == -1)
+    return 1;
+
+  CHECK(dotenv_compile(source, image) == 0);
+
+  // With nothing loaded, the image is published as is
+  int64_t n = 0;
+
+  CHECK(dotenv_load_compiled(image) == 0);
+  CHECK_VALUE("HOST", "db");
+  CHECK_VALUE("URL", "db:5432");
+  CHECK_VALUE("MISSING", NULL);
+  CHECK(dotenv_get_int64("N", &n) == 0 && n == 42);
+  CHECK(dotenv_get_int64("N", &n) == 0 && n == 42);
+
+  // Files loaded afterwards are merged over it without replacing its keys
+  CHECK(dotenv_load(other) == 0);
+  CHECK_VALUE("HOST", "db");
+  CHECK_VALUE("EXTRA", "1");
+  dotenv_free();
+
+  // Loaded after a file, the image is merged into the published table
+  CHECK(dotenv_load(other) == 0);
+  CHECK(dotenv_load_compiled(image) == 0);
+  CHECK_VALUE("HOST", "local");
+  CHECK_VALUE("URL", "db:5432");
+  CHECK_VALUE("EXTRA", "1");
+  dotenv_free();
+
+  // A damaged image is rejected
+  FILE *file = fopen(image, "r+b");
+
+  if (file) {
+    fseek(file, -2, SEEK_END);
+    fputc('X', file);
+    fclose(file);
+  }
+
+  CHECK(dotenv_load_compiled(image) == -1);
+  CHECK_VALUE("HOST", NULL);
+  dotenv_free();
+
+  remove(source);
+  remove(image);
+  remove(other);
+  rmdir(directory);
+
+  return cenv_test_failures != 0;
+}
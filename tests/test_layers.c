@@ -0,0 +1,67 @@
+/**
+ * @file test_layers.c
+ * @brief Precedence and self references across layered files.
+ */
+#include "cenv_test.h"
+
+int main(void) {
+  char directory[32];
+  char base[64];
+  char local[64];
+  char override[64];
+  char single[64];
+
+  if (cenv_test_directory(directory) == -1)
+    return 1;
+
+  snprintf(base, sizeof(base), "%s/base.env", directory);
+  snprintf(local, sizeof(local), "%s/local.env", directory);
+  snprintf(override, sizeof(override), "%s/override.env", directory);
+  snprintf(single, sizeof(single), "%s/single.env", directory);
+
+  if (cenv_test_write(base, "P=base\nHOST=db\nURL=${HOST}:5432\nQ=${P}\n") ==
+          -1 ||
+      cenv_test_write(local, "P=${P}:x\nHOST=local\nA=1\nA=2\n") == -1 ||
+      cenv_test_write(override, "P=${P}:y\n") == -1 ||
+      cenv_test_write(single, "A=1\nA=2\n") == -1)
+    return 1;
+
+  // A self reference extends the definition from the layer below
+  const char *two[] = {base, local};
+
+  CHECK(dotenv_load_layers(two, 2) == 0);
+  CHECK_VALUE("P", "base:x");
+  CHECK_VALUE("Q", "base:x");
+  CHECK_VALUE("URL", "local:5432");
+  dotenv_free();
+
+  // And chains through every layer
+  const char *three[] = {base, local, override};
+
+  CHECK(dotenv_load_layers(three, 3) == 0);
+  CHECK_VALUE("P", "base:x:y");
+  dotenv_free();
+
+  // Within a file the first definition wins, as with dotenv_load
+  CHECK(dotenv_load(single) == 0);
+  CHECK_VALUE("A", "1");
+  dotenv_free();
+
+  const char *one[] = {single};
+
+  CHECK(dotenv_load_layers(one, 1) == 0);
+  CHECK_VALUE("A", "1");
+  dotenv_free();
+
+  CHECK(dotenv_load_layers(two, 2) == 0);
+  CHECK_VALUE("A", "1");
+  dotenv_free();
+
+  remove(base);
+  remove(local);
+  remove(override);
+  remove(single);
+  rmdir(directory);
+
+  return cenv_test_failures != 0;
+}
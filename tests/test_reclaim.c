@@ -0,0 +1,185 @@
+/**
+ * @file test_reclaim.c
+ * @brief Readers holding views and cursors while a watched file is reloaded,
+ * so superseded tables are reclaimed under them.
+ *
+ * Run under AddressSanitizer, a table freed while still read shows up as a
+ * use after free; under ThreadSanitizer, as a data race.
+ */
+#include "cenv_test.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/// Number of reader threads.
+#define TEST_READERS 4
+
+/// Number of reloads of the watched file.
+#define TEST_RELOADS 100
+
+/// Number of keys sharing the `KEY_` prefix in the watched file.
+#define TEST_KEYS 64
+
+/// Set once the reloads are done.
+static atomic_int test_stop;
+
+/// Number of checks failed by the readers.
+static atomic_int test_reader_failures;
+
+/**
+ * @brief Checks a generation value against the value of `GEN`.
+ *
+ * @param value A value read as `V=${GEN}-value`.
+ * @return 1 if it has the expected form, 0 otherwise.
+ */
+static int test_value_valid(const char *value) {
+  const char *dash = value ? strchr(value, '-') : NULL;
+
+  return dash && dash != value && strcmp(dash, "-value") == 0;
+}
+
+/**
+ * @brief Reads views, typed values and cursors until the reloads are done.
+ *
+ * A view taken first is checked again at the end, since values must stay
+ * valid until `dotenv_free` whatever was reloaded meanwhile.
+ *
+ * @param arg Unused.
+ * @return NULL.
+ */
+static void *test_reader(void *arg) {
+  const char *first;
+  size_t first_len;
+  char copy[64] = "";
+
+  (void)arg;
+
+  if (dotenv_get_view("V", &first, &first_len) == 0 &&
+      first_len < sizeof(copy)) {
+    memcpy(copy, first, first_len + 1);
+  }
+
+  while (!atomic_load(&test_stop)) {
+    const char *value;
+    size_t len;
+    int64_t generation;
+
+    if (dotenv_get_view("V", &value, &len) != 0 || !test_value_valid(value) ||
+        strlen(value) != len) {
+      atomic_fetch_add(&test_reader_failures, 1);
+    }
+
+    if (dotenv_get_int64("GEN", &generation) != 0 || generation < 0) {
+      atomic_fetch_add(&test_reader_failures, 1);
+    }
+
+    // The cursor stays open across reloads, pinning the table it walks
+    dotenv_cursor cursor;
+    const char *key;
+    int count = 0;
+
+    if (dotenv_cursor_open(&cursor, "KEY_") != 0) {
+      atomic_fetch_add(&test_reader_failures, 1);
+      continue;
+    }
+
+    while (dotenv_cursor_next(&cursor, &key, &value) == 0) {
+      if (strncmp(key, "KEY_", 4) != 0 || !test_value_valid(value)) {
+        atomic_fetch_add(&test_reader_failures, 1);
+      }
+
+      if (++count % 16 == 0) {
+        cenv_test_sleep_ms(1);
+      }
+    }
+
+    if (count != TEST_KEYS) {
+      atomic_fetch_add(&test_reader_failures, 1);
+    }
+  }
+
+  if (copy[0] && (strlen(first) != first_len || strcmp(first, copy) != 0)) {
+    atomic_fetch_add(&test_reader_failures, 1);
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Writes the watched file for a generation.
+ *
+ * @param path The watched file.
+ * @param generation The generation.
+ * @return 0 on success, -1 if the file cannot be written.
+ */
+static int test_write_generation(const char *path, int generation) {
+  char contents[TEST_KEYS * 32 + 64];
+  int used = snprintf(contents, sizeof(contents), "GEN=%d\nV=${GEN}-value\n",
+                      generation);
+
+  for (int i = 0; i < TEST_KEYS; i++) {
+    // Half of the keys change on every reload, the others never do
+    used += snprintf(contents + used, sizeof(contents) - used,
+                     "KEY_%d=%d-value\n", i, i % 2 ? generation : i);
+  }
+
+  return cenv_test_write(path, contents);
+}
+
+/**
+ * @brief Reloads the watched file while readers run.
+ *
+ * @param directory Directory holding the test files.
+ * @param flags Options passed to `dotenv_watch`.
+ */
+static void test_reclaim(const char *directory, unsigned flags) {
+  char path[64];
+  pthread_t readers[TEST_READERS];
+  char expected[16];
+
+  snprintf(path, sizeof(path), "%s/reclaim.env", directory);
+
+  if (test_write_generation(path, 0) == -1 || dotenv_watch(path, flags) == -1) {
+    cenv_test_failures++;
+    return;
+  }
+
+  atomic_store(&test_stop, 0);
+
+  for (int i = 0; i < TEST_READERS; i++) {
+    pthread_create(&readers[i], NULL, test_reader, NULL);
+  }
+
+  for (int generation = 1; generation <= TEST_RELOADS; generation++) {
+    snprintf(expected, sizeof(expected), "%d", generation);
+    test_write_generation(path, generation);
+    CHECK(cenv_test_wait("GEN", expected));
+  }
+
+  atomic_store(&test_stop, 1);
+
+  for (int i = 0; i < TEST_READERS; i++) {
+    pthread_join(readers[i], NULL);
+  }
+
+  snprintf(expected, sizeof(expected), "%d-value", TEST_RELOADS);
+  CHECK_VALUE("V", expected);
+  CHECK(atomic_load(&test_reader_failures) == 0);
+
+  dotenv_unwatch();
+  dotenv_free();
+  remove(path);
+}
+
+int main(void) {
+  char directory[32];
+
+  if (cenv_test_directory(directory) == -1)
+    return 1;
+
+  test_reclaim(directory, 0);
+  test_reclaim(directory, DOTENV_LOAD_LAZY);
+  rmdir(directory);
+
+  return cenv_test_failures != 0;
+}
@@ -0,0 +1,90 @@
+/**
+ * @file test_watch.c
+ * @brief Reloads of a watched file: changed values, dependents and removed
+ * keys, with eager and lazy interpolation.
+ */
+#include "cenv_test.h"
+
+/**
+ * @brief Runs the reload checks with one set of load options.
+ *
+ * @param directory Directory holding the test files.
+ * @param flags Options passed to every load.
+ */
+static void test_reloads(const char *directory, unsigned flags) {
+  char base[64];
+  char watched[64];
+
+  snprintf(base, sizeof(base), "%s/base.env", directory);
+  snprintf(watched, sizeof(watched), "%s/watched.env", directory);
+
+  if (cenv_test_write(base, "K=orig\nP=/bin\n") == -1 ||
+      cenv_test_write(watched, "K=one\nDEP=${K}-x\nP=${P}:/opt\nGONE=1\n") ==
+          -1) {
+    cenv_test_failures++;
+    return;
+  }
+
+  CHECK(dotenv_load_ex(base, flags) == 0);
+  CHECK(dotenv_watch(watched, flags) == 0);
+  CHECK_VALUE("K", "one");
+  CHECK_VALUE("DEP", "one-x");
+  CHECK_VALUE("P", "/bin:/opt");
+  CHECK_VALUE("GONE", "1");
+
+  const char *kept = dotenv_get("GONE");
+
+  // A changed value is picked up along with the values depending on it
+  cenv_test_write(watched, "K=two\nDEP=${K}-x\nP=${P}:/opt\nGONE=1\n");
+  CHECK(cenv_test_wait("K", "two"));
+  CHECK_VALUE("DEP", "two-x");
+  CHECK_VALUE("P", "/bin:/opt");
+  CHECK(dotenv_get("GONE") == kept);
+
+  // A changed dependent is interpolated again on its own
+  cenv_test_write(watched, "K=two\nDEP=${K}-y\nP=${P}:/opt\nGONE=1\n");
+  CHECK(cenv_test_wait("DEP", "two-y"));
+  CHECK_VALUE("K", "two");
+
+  // Removed keys revert to the definitions the file was loaded over
+  cenv_test_write(watched, "DEP=${K}-y\nP=${P}:/opt\n");
+  CHECK(cenv_test_wait("GONE", NULL));
+  CHECK_VALUE("K", "orig");
+  CHECK_VALUE("DEP", "orig-y");
+  CHECK_VALUE("P", "/bin:/opt");
+
+  // And come back when they are added again
+  cenv_test_write(watched, "K=three\nDEP=${K}-y\nP=${P}:/opt\n");
+  CHECK(cenv_test_wait("K", "three"));
+  CHECK_VALUE("DEP", "three-y");
+
+  // A reload that fails keeps the previous configuration, also when values
+  // are expanded lazily
+  cenv_test_write(watched, "K=${DEP}\nDEP=${K}-y\nP=${P}:/opt\nNEXT=1\n");
+  cenv_test_sleep_ms(200);
+  CHECK_VALUE("K", "three");
+  CHECK_VALUE("DEP", "three-y");
+  CHECK_VALUE("NEXT", NULL);
+
+  cenv_test_write(watched, "K=four\nDEP=${K}-y\nP=${P}:/opt\nNEXT=1\n");
+  CHECK(cenv_test_wait("NEXT", "1"));
+  CHECK_VALUE("DEP", "four-y");
+
+  dotenv_unwatch();
+  dotenv_free();
+  remove(base);
+  remove(watched);
+}
+
+int main(void) {
+  char directory[32];
+
+  if (cenv_test_directory(directory) == -1)
+    return 1;
+
+  test_reloads(directory, 0);
+  test_reloads(directory, DOTENV_LOAD_LAZY);
+  rmdir(directory);
+
+  return cenv_test_failures != 0;
+}
@@ -0,0 +1,26 @@
+/**
+ * @file cenv_embed.c
+ * @brief Generates a C header embedding a `.env` file.
+ *
+ * Resolves every variable of the file and writes them as `static const`
+ * tables with a minimal perfect hash over the keys. Programs that include the
+ * generated header instead of `cenv.h` read the variables with `dotenv_get`
+ * without loading anything at runtime.
+ *
+ * Usage: cenv_embed <input.env> <output.h>
+ */
+#include <cenv.h>
+#include <stdio.h>
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s <input.env> <output.h>\n", argv[0]);
+    return 1;
+  }
+
+  if (dotenv_embed(argv[1], argv[2]) == -1)
+    return 1;
+
+  dotenv_free();
+  return 0;
+}